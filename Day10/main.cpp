@@ -1,12 +1,15 @@
 #include "aoc/helpers.h"
+#include "aoc/bigint.h"
 
 #include <algorithm>
-#include <unordered_map>
+#include <map>
 #include <vector>
 
 namespace {
   using MappedFileSource = aoc::MappedFileSource<char>;
 
+  STRING_CONSTANT(CHAIN, "chain");
+
   constexpr std::string_view SampleInput(R"(28
 33
 18
@@ -38,10 +41,13 @@ namespace {
 34
 10
 3)");
-  constexpr int SR_Part1 = 220;
-  constexpr int SR_Part2 = 19208;
+  constexpr size_t SR_Part1 = 220;
+  constexpr uint64_t SR_Part2 = 19208;
+
+  // The device always rates this much higher than the highest adapter
+  constexpr int64_t DeviceOffset = 3;
 
-  using Input = std::vector<int>;
+  using Input = std::vector<int64_t>;
 
   const auto LoadInput = [](auto f) {
     Input r;
@@ -52,40 +58,192 @@ namespace {
     return r;
   };
 
-  const auto FindDistribution = [](const auto& input) {
-    int previous = 0;
-    int jolt_1 = 0;
-    int jolt_3 = 0;
-    for (const auto& i : input) {
-        if (i == previous + 1) { jolt_1++; }
-        else if (i == previous + 3) { jolt_3++; }
-        previous = i;
+  // Sorts joltages by counting occurrences over [0, max]. Adapter ratings
+  // are small and dense, so this beats a comparison sort; fall back to one
+  // when the range is much wider than the input.
+  void CountingSort(Input& input) {
+    if (input.empty()) { return; }
+
+    const auto [lo, hi] = std::minmax_element(input.begin(), input.end());
+    if (*lo < 0 || size_t(*hi) > 16 * input.size() + 1024) {
+      std::sort(input.begin(), input.end());
+      return;
     }
-    return jolt_1 * (jolt_3 + 1);
-  };
 
-  using Memoization = std::unordered_map<int, int64_t>;
-  int64_t GetArrangments(size_t start, const Input& input, Memoization& map) {
-    if (start == input.size() - 1) { return 1; }
+    std::vector<uint32_t> counts(*hi + 1, 0);
+    for (const auto& i : input) { counts[i]++; }
 
-    const auto r = map.find(start);
-    if (r != map.end()) {
-      return r->second;
+    auto out = input.begin();
+    for (size_t v = 0; v < counts.size(); v++) {
+      out = std::fill_n(out, counts[v], int64_t(v));
     }
+  }
+
+  using Count = aoc::BigUint;
 
-    int64_t total = 0;
-    for (size_t i = start + 1; i < input.size(); i++) {
-      const int64_t range = input[i] - input[start];
-      if (range > 3) {
-        break;
+  // Number of ways to chain from the outlet (0) through some of the sorted
+  // adapters to the device, with each step rising by at most `jump` jolts.
+  // ways[i] is the sum of ways[j] over the preceding adapters within `jump`,
+  // kept as a running window sum so each adapter costs one add and amortised
+  // one subtract, whatever the jump limit. Counts promote to big integers
+  // once they no longer fit in 64 bits.
+  Count CountArrangements(const Input& sorted, int64_t jump) {
+    const size_t n = sorted.size() + 2;
+    const int64_t device = (sorted.empty() ? 0 : sorted.back()) + DeviceOffset;
+    const auto value = [&](size_t i) {
+      return i == 0 ? int64_t(0) : i < n - 1 ? sorted[i - 1] : device;
+    };
+
+    std::vector<Count> ways(n);
+    ways[0] = 1;
+    Count window = 0;
+    size_t lo = 0;
+    for (size_t i = 1; i < n; i++) {
+      window += ways[i - 1];
+      while (lo < i && value(i) - value(lo) > jump) {
+        window -= ways[lo];
+        lo++;
       }
-      total += GetArrangments(i, input, map);
+      ways[i] = window;
     }
 
-    map.emplace(start, total);
+    return ways.back();
+  }
+
+  // A run of `length` consecutive gaps of the same size
+  struct GapRun {
+    int64_t gap;
+    uint64_t length;
+  };
+
+  // The gaps along the whole chain, from the outlet through every sorted
+  // adapter to the device, as both a histogram and a run-length encoding.
+  // Neither depends on how large the ratings are, only on how many
+  // adapters there are.
+  struct ChainStats {
+    std::map<int64_t, size_t> histogram;
+    std::vector<GapRun> runs;
 
-    return total;
+    size_t count(int64_t gap) const {
+      const auto it = histogram.find(gap);
+      return it == histogram.end() ? 0 : it->second;
+    }
+  };
+
+  ChainStats GetChainStats(const Input& sorted) {
+    ChainStats stats;
+    const auto add = [&stats](int64_t gap) {
+      stats.histogram[gap]++;
+      if (!stats.runs.empty() && stats.runs.back().gap == gap) {
+        stats.runs.back().length++;
+      } else {
+        stats.runs.push_back({ gap, 1 });
+      }
+    };
+
+    int64_t previous = 0;
+    for (const auto& i : sorted) {
+      add(i - previous);
+      previous = i;
+    }
+    add(DeviceOffset);
+
+    return stats;
   }
+
+  const auto FindDistribution = [](const ChainStats& stats) {
+    return stats.count(1) * stats.count(3);
+  };
+
+  // Counts arrangements in O(number of runs) rather than O(adapters), by
+  // tracking the ways to reach each of the ratings up to `jump` below the
+  // current one. A step by gap g is a square matrix over those offsets, so a run of k
+  // equal gaps is that matrix to the k-th power, computed by squaring and
+  // kept in a table for runs that repeat. For jump 3 and runs of 1 jolt
+  // gaps this gives the familiar 1, 1, 2, 4, 7, 13... multipliers.
+  class GapEngine {
+  private:
+    using Matrix = std::vector<Count>;
+
+    int64_t jump_;
+    size_t dim_;
+    std::map<std::pair<int64_t, uint64_t>, Matrix> powers_;
+
+    Matrix multiply(const Matrix& a, const Matrix& b) const {
+      Matrix r(dim_ * dim_);
+      for (size_t i = 0; i < dim_; i++) {
+        for (size_t k = 0; k < dim_; k++) {
+          if (a[i * dim_ + k] == 0) { continue; }
+          for (size_t j = 0; j < dim_; j++) {
+            if (b[k * dim_ + j] == 0) { continue; }
+            r[i * dim_ + j] += a[i * dim_ + k] * b[k * dim_ + j];
+          }
+        }
+      }
+      return r;
+    }
+
+    // state[o] is the ways to reach the rating o below the current one.
+    // After a step of `gap`, the new rating is reached from every old
+    // offset still within the jump, and the rest shift down by `gap`. A
+    // duplicate rating (gap 0) can reach back the full jump, so offsets run
+    // from 0 to jump inclusive.
+    Matrix step(int64_t gap) const {
+      Matrix m(dim_ * dim_);
+      for (int64_t o = 0; o + gap <= jump_; o++) {
+        m[o] = 1;
+      }
+      for (int64_t r = gap; r < int64_t(dim_); r++) {
+        m[r * dim_ + (r - gap)] += 1;
+      }
+      return m;
+    }
+
+    const Matrix& power(int64_t gap, uint64_t length) {
+      const auto key = std::make_pair(gap, length);
+      const auto it = powers_.find(key);
+      if (it != powers_.end()) { return it->second; }
+
+      Matrix r(dim_ * dim_);
+      for (size_t i = 0; i < dim_; i++) { r[i * dim_ + i] = 1; }
+      Matrix b = step(gap);
+      for (uint64_t k = length; k; k >>= 1) {
+        if (k & 1) { r = multiply(r, b); }
+        if (k > 1) { b = multiply(b, b); }
+      }
+      return powers_.emplace(key, std::move(r)).first->second;
+    }
+
+  public:
+    // Wider jumps make the matrices too large to be worth it
+    static constexpr int64_t MaxJump = 16;
+
+    GapEngine(int64_t jump)
+      : jump_(jump)
+      , dim_(jump + 1)
+    {
+      assert(jump > 0 && jump <= MaxJump);
+    }
+
+    Count count(const ChainStats& stats) {
+      std::vector<Count> state(dim_);
+      state[0] = 1;
+      for (const auto& run : stats.runs) {
+        if (run.gap > jump_) { return 0; }
+
+        const auto& m = power(run.gap, run.length);
+        std::vector<Count> next(dim_);
+        for (size_t i = 0; i < dim_; i++) {
+          for (size_t j = 0; j < dim_; j++) {
+            if (m[i * dim_ + j] == 0 || state[j] == 0) { continue; }
+            next[i] += m[i * dim_ + j] * state[j];
+          }
+        }
+        state.swap(next);
+      }
+      return state[0];
+    }
+  };
 }
 
 int main(int argc, char** argv) {
@@ -93,31 +251,42 @@ int main(int argc, char** argv) {
   const bool inTest = argc < 2;
 
   Input r;
+  int64_t jump = 3;
   if (inTest) {
     r = LoadInput(SampleInput);
+  } else if (CHAIN == argv[1]) {
+    // A run of consecutive adapters 1..n, whose arrangements grow like the
+    // tribonacci numbers and overflow 64 bits from n = 74
+    const int64_t n = argc > 2 ? aoc::stoi(argv[2]) : 100;
+    jump = argc > 3 ? aoc::stoi(argv[3]) : jump;
+    for (int64_t i = n; i > 0; i--) {
+      r.push_back(i);
+    }
   } else {
     std::unique_ptr<MappedFileSource>m(new MappedFileSource(argc, argv));
     std::string_view f(m->data(), m->size());
     r = LoadInput(f);
+    jump = argc > 2 ? aoc::stoi(argv[2]) : jump;
   }
 
-  std::sort(r.begin(), r.end());
-
-  int part1 = FindDistribution(r);
+  CountingSort(r);
 
-  // Add our built-in adapter at the back
-  r.emplace_back(r.back() + 3);
-  // And the 0 rated at the front
-  r.insert(r.begin(), 0);
+  const auto stats = GetChainStats(r);
 
-  Memoization map;
-  int64_t part2 = GetArrangments(0, r, map);
+  size_t part1 = FindDistribution(stats);
+  Count part2 = jump > 0 && jump <= GapEngine::MaxJump ?
+    GapEngine(jump).count(stats) : CountArrangements(r, jump);
 
   aoc::print_results(part1, part2);
 
   if (inTest) {
     aoc::assert_result(part1, SR_Part1);
     aoc::assert_result(part2, SR_Part2);
+
+    // The run-length engine and the adapter by adapter DP must agree
+    for (int64_t j = 1; j <= 4; j++) {
+      aoc::assert_result(GapEngine(j).count(stats), CountArrangements(r, j));
+    }
   }
 
   return 0;
@@ -1,12 +1,26 @@
 #include "aoc/helpers.h"
 
+#include <condition_variable>
+#include <mutex>
+#include <numeric>
+#include <random>
+#include <thread>
+#include <tuple>
 #include <vector>
 #include <map>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
 namespace {
   using Result = std::pair<int, int>;
   using MappedFileSource = aoc::MappedFileSource<char>;
 
+  STRING_CONSTANT(CHECK, "check");
+  STRING_CONSTANT(STATS, "stats");
+  STRING_CONSTANT(BENCH_THREADS, "bench-threads");
+
   constexpr std::string_view SampleInput(R"(L.LL.LL.LL
 LLLLLLL.LL
 L.L.L..L..
@@ -195,17 +209,21 @@ L.LLLLL.LL)");
       return occupied;
     }
 
+    // Dimensions including the halo
+    size_t grid_width() const { return width; }
+    size_t grid_height() const { return height; }
+
   private:
     size_t index_of(size_t x, size_t y) const {
       assert(x < width);
       assert(y < height);
 
-      return y * height + x;
+      return y * width + x;
     }
 
     int get_occupied_adjacent(size_t x, size_t y) const {
-      assert(x > 1 && x < width - 1);
-      assert(y > 1 && y < height - 1);
+      assert(x > 0 && x < width - 1);
+      assert(y > 0 && y < height - 1);
 
       int count = 0;
       for (const auto &o : AdjacencyOffsets) {
@@ -216,8 +234,8 @@ L.LLLLL.LL)");
     }
 
     int get_occupied_adjacent2(size_t x, size_t y) const {
-      assert(x > 1 && x < width - 1);
-      assert(y > 1 && y < height - 1);
+      assert(x > 0 && x < width - 1);
+      assert(y > 0 && y < height - 1);
 
       int count = 0;
       for (const auto &o : AdjacencyOffsets) {
@@ -237,6 +255,528 @@ L.LLLLL.LL)");
     }
   };
 
+  // Blocks until `threads` callers have arrived, then releases them all and
+  // resets for the next round
+  class Barrier {
+  private:
+    std::mutex m;
+    std::condition_variable cv;
+    size_t threads;
+    size_t waiting;
+    size_t phase;
+
+  public:
+    Barrier(size_t n)
+      : threads(n)
+      , waiting(0)
+      , phase(0)
+    { }
+
+    void wait() {
+      std::unique_lock<std::mutex> lock(m);
+      const size_t p = phase;
+      if (++waiting == threads) {
+        waiting = 0;
+        phase++;
+        cv.notify_all();
+      } else {
+        cv.wait(lock, [&] { return phase != p; });
+      }
+    }
+  };
+
+  // Part 1 on a pair of byte grids, 1 for an occupied seat and 0 otherwise,
+  // which swap roles each generation instead of being copied. Rows keep the
+  // FloorPlan halo and are padded out to whole vectors, so the kernel can
+  // read the 3x3 neighbourhood of any cell without bounds checks.
+  class PackedFloorPlan {
+  private:
+    static constexpr size_t Lanes = 32;
+
+    size_t width;
+    size_t height;
+    size_t stride;
+    std::vector<uint8_t> seats;
+    std::vector<uint8_t> cells[2];
+    size_t current;
+
+    size_t index_of(size_t x, size_t y) const {
+      return y * stride + x;
+    }
+
+  public:
+    PackedFloorPlan(const FloorPlan& fp)
+      : width(fp.grid_width() - 2)
+      , height(fp.grid_height() - 2)
+      // Room for a final, partial vector starting at column `width`
+      , stride((width + 1 + Lanes + Lanes - 1) / Lanes * Lanes)
+      , seats((height + 2) * stride, 0)
+      , current(0)
+    {
+      cells[0].resize(seats.size(), 0);
+      cells[1].resize(seats.size(), 0);
+      for (size_t y = 1; y <= height; y++) {
+        for (size_t x = 1; x <= width; x++) {
+          const auto p = fp.get(x, y);
+          seats[index_of(x, y)] = p != Position::Floor;
+          cells[0][index_of(x, y)] = p == Position::Occupied;
+        }
+      }
+    }
+
+    // Advances `n` interior cells of one row. The 3x3 sums include the cell
+    // itself, so an empty seat fills when its sum is 0 and an occupied one
+    // stays while its sum is at most 4. Returns whether any cell changed.
+    static bool step_row(const uint8_t* above, const uint8_t* row, const uint8_t* below,
+      const uint8_t* seat, uint8_t* out, size_t n) {
+#if defined(__AVX2__)
+      const auto load = [](const uint8_t* p) {
+        return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+      };
+      const auto row_sum = [&load](const uint8_t* p) {
+        return _mm256_add_epi8(_mm256_add_epi8(load(p - 1), load(p)), load(p + 1));
+      };
+
+      const __m256i zero = _mm256_setzero_si256();
+      const __m256i four = _mm256_set1_epi8(4);
+      __m256i changed = zero;
+      for (size_t i = 0; i < n; i += Lanes) {
+        const __m256i sum = _mm256_add_epi8(_mm256_add_epi8(row_sum(above + i), row_sum(row + i)), row_sum(below + i));
+        const __m256i self = load(row + i);
+        const __m256i fill = _mm256_cmpeq_epi8(sum, zero);
+        const __m256i stay = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_min_epu8(sum, four), sum),
+          _mm256_cmpgt_epi8(self, zero));
+        const __m256i next = _mm256_and_si256(_mm256_or_si256(fill, stay), load(seat + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), next);
+        changed = _mm256_or_si256(changed, _mm256_xor_si256(next, self));
+      }
+      return !_mm256_testz_si256(changed, changed);
+#else
+      uint8_t changed = 0;
+      for (size_t i = 0; i < n; i++) {
+        const int sum = above[i - 1] + above[i] + above[i + 1] +
+          row[i - 1] + row[i] + row[i + 1] +
+          below[i - 1] + below[i] + below[i + 1];
+        const uint8_t next = seat[i] & (sum == 0 || (row[i] && sum <= 4));
+        out[i] = next;
+        changed |= next ^ row[i];
+      }
+      return changed;
+#endif
+    }
+
+  private:
+    // Advances rows [y0, y1) from `from` into `to`, which both hold grid
+    // rows starting at `base`
+    bool step_rows(const uint8_t* from, uint8_t* to, size_t base, size_t y0, size_t y1) const {
+      bool changed = false;
+      for (size_t y = y0; y < y1; y++) {
+        const uint8_t* row = from + (y - base) * stride + 1;
+        changed |= step_row(row - stride, row, row + stride, &seats[index_of(1, y)],
+          to + (y - base) * stride + 1, width);
+      }
+      return changed;
+    }
+
+    // Advances rows [y0, y1) by `k` generations from `from` into `to`. For
+    // k > 1 this works on a private copy of the tile with k ghost rows
+    // either side, each generation computing one row fewer at each edge, so
+    // nothing outside the copy is needed until the tile is written back.
+    // Bit j of the result is set if generation j changed the tile.
+    uint64_t step_tile(const std::vector<uint8_t>& from, std::vector<uint8_t>& to,
+      size_t y0, size_t y1, size_t k, std::vector<uint8_t> (&local)[2]) const {
+      if (k == 1) {
+        return step_rows(from.data(), to.data(), 0, y0, y1);
+      }
+
+      // The halo rows are always empty, so they can stand in for ghosts
+      const size_t base = y0 > k ? y0 - k : 0;
+      const size_t end = std::min(height + 2, y1 + k);
+      local[0].assign(from.begin() + base * stride, from.begin() + end * stride);
+      local[1].assign(local[0].size(), 0);
+
+      uint64_t mask = 0;
+      for (size_t j = 1; j <= k; j++) {
+        const uint8_t* src = local[(j - 1) & 1].data();
+        uint8_t* dst = local[j & 1].data();
+        const size_t lo = std::max<size_t>(1, y0 > k - j ? y0 - (k - j) : 0);
+        const size_t hi = std::min(height + 1, y1 + (k - j));
+        step_rows(src, dst, base, lo, y0);
+        mask |= uint64_t(step_rows(src, dst, base, y0, y1)) << (j - 1);
+        step_rows(src, dst, base, y1, hi);
+      }
+
+      const auto& result = local[k & 1];
+      std::copy(result.begin() + (y0 - base) * stride, result.begin() + (y1 - base) * stride,
+        to.begin() + y0 * stride);
+      return mask;
+    }
+
+  public:
+    bool iterate() {
+      const bool changed = step_rows(cells[current].data(), cells[current ^ 1].data(), 0, 1, height + 1);
+      current ^= 1;
+
+      return !changed;
+    }
+
+    // Runs until a generation changes nothing, or for `limit` generations,
+    // returning how many generations changed something (as counted by a
+    // loop over iterate()). The rows are split into one band per thread,
+    // and each band is stepped `block` generations at a time, in tiles
+    // sized to stay in L2, with one barrier per block. Bands read each
+    // other's edge rows straight from the shared grid, which is all the
+    // halo exchange there is to do.
+    size_t run(size_t threads, size_t block, size_t limit) {
+      constexpr size_t CacheBytes = 256 * 1024;
+      block = std::clamp<size_t>(block, 1, 64);
+      threads = std::clamp<size_t>(threads, 1, height);
+      // Two tile copies and the seat rows
+      const size_t tile_rows = std::max(block, CacheBytes / (3 * stride) > 2 * block ?
+        CacheBytes / (3 * stride) - 2 * block : 0);
+
+      Barrier barrier(threads);
+      std::vector<uint64_t> masks[2] = { std::vector<uint64_t>(threads), std::vector<uint64_t>(threads) };
+      const size_t start = current;
+      size_t generations = 0;
+
+      const auto worker = [&](size_t t) {
+        const size_t y0 = 1 + height * t / threads;
+        const size_t y1 = 1 + height * (t + 1) / threads;
+        std::vector<uint8_t> local[2];
+
+        size_t cur = start;
+        size_t done = 0;
+        size_t changed = 0;
+        for (size_t b = 0; done < limit; b++) {
+          const size_t k = std::min(block, limit - done);
+          uint64_t mask = 0;
+          for (size_t y = y0; y < y1; y += tile_rows) {
+            mask |= step_tile(cells[cur], cells[cur ^ 1], y, std::min(y1, y + tile_rows), k, local);
+          }
+          // Alternate between two sets of masks, so none is overwritten
+          // before every thread has read it
+          masks[b & 1][t] = mask;
+          barrier.wait();
+
+          uint64_t all = 0;
+          for (const auto& m : masks[b & 1]) { all |= m; }
+          cur ^= 1;
+          done += k;
+          // A generation that changes nothing is a fixed point, so the
+          // ones after it in the block changed nothing either
+          const uint64_t full = k == 64 ? ~uint64_t(0) : (uint64_t(1) << k) - 1;
+          if (all != full) {
+            changed += __builtin_ctzll(~all);
+            break;
+          }
+          changed += k;
+        }
+
+        if (t == 0) {
+          generations = changed;
+          current = cur;
+        }
+      };
+
+      std::vector<std::thread> workers;
+      for (size_t t = 1; t < threads; t++) {
+        workers.emplace_back(worker, t);
+      }
+      worker(0);
+      for (auto& w : workers) { w.join(); }
+
+      return generations;
+    }
+
+    size_t occupied_count() const {
+      return std::accumulate(cells[current].begin(), cells[current].end(), size_t(0));
+    }
+
+    bool matches(const PackedFloorPlan& o) const {
+      return cells[current] == o.cells[o.current];
+    }
+
+    bool matches(const FloorPlan& fp) const {
+      for (size_t y = 1; y <= height; y++) {
+        for (size_t x = 1; x <= width; x++) {
+          if (cells[current][index_of(x, y)] != (fp.get(x, y) == Position::Occupied)) {
+            return false;
+          }
+        }
+      }
+      return true;
+    }
+  };
+
+  // Whether `occupied`, one entry per seat in row-major order, matches the
+  // seating in `fp`
+  bool SeatsMatch(const std::vector<uint8_t>& occupied, const FloorPlan& fp) {
+    size_t i = 0;
+    for (size_t y = 1; y < fp.grid_height() - 1; y++) {
+      for (size_t x = 1; x < fp.grid_width() - 1; x++) {
+        const auto p = fp.get(x, y);
+        if (p != Position::Floor && occupied[i++] != (p == Position::Occupied)) {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+  enum class Visibility {
+    Adjacent,
+    LineOfSight,
+  };
+
+  // The seats alone, with the neighbours each one takes into account. Which
+  // seats those are never changes, so they're worked out once into a CSR
+  // table (the neighbours of seat i are neighbours[offsets[i]..offsets[i + 1]])
+  // and each generation is then a pass over dense arrays, with floor cells
+  // gone entirely. Part 1 is Adjacent with a tolerance of 4, part 2
+  // LineOfSight with 5.
+  class SeatGraph {
+  private:
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> neighbours;
+    std::vector<uint8_t> occupied[2];
+    size_t current;
+    int tolerance_;
+
+  public:
+    SeatGraph(const FloorPlan& fp, Visibility visibility, int tolerance)
+      : current(0)
+      , tolerance_(tolerance)
+    {
+      const size_t width = fp.grid_width() - 2;
+      const size_t height = fp.grid_height() - 2;
+      constexpr uint32_t None = UINT32_MAX;
+
+      // One row-major sweep, remembering the last seat seen along each
+      // row, column, diagonal and anti-diagonal and the step along that
+      // line it was at. Any seat on the same line is the closest one
+      // visible in that direction; only one a step away is adjacent.
+      struct LastSeat {
+        uint32_t seat = None;
+        size_t step = 0;
+      };
+      std::vector<LastSeat> last_column(width);
+      std::vector<LastSeat> last_diagonal(width + height);
+      std::vector<LastSeat> last_anti_diagonal(width + height);
+      std::vector<std::pair<uint32_t, uint32_t>> edges;
+      uint32_t n = 0;
+      for (size_t y = 0; y < height; y++) {
+        LastSeat last_row;
+        for (size_t x = 0; x < width; x++) {
+          const auto p = fp.get(x + 1, y + 1);
+          if (p == Position::Floor) { continue; }
+
+          occupied[0].push_back(p == Position::Occupied);
+          const std::pair<LastSeat*, size_t> lines[] = {
+            { &last_row, x },
+            { &last_column[x], y },
+            { &last_diagonal[x + height - y], y },
+            { &last_anti_diagonal[x + y], y },
+          };
+          for (const auto& [last, step] : lines) {
+            if (last->seat != None && (visibility == Visibility::LineOfSight || last->step + 1 == step)) {
+              edges.emplace_back(last->seat, n);
+            }
+            *last = { n, step };
+          }
+          n++;
+        }
+      }
+
+      offsets.assign(n + 1, 0);
+      for (const auto& [a, b] : edges) {
+        offsets[a + 1]++;
+        offsets[b + 1]++;
+      }
+      std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+      neighbours.resize(offsets.back());
+      std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+      for (const auto& [a, b] : edges) {
+        neighbours[fill[a]++] = b;
+        neighbours[fill[b]++] = a;
+      }
+
+      occupied[1].resize(n, 0);
+    }
+
+    size_t size() const { return occupied[current].size(); }
+    int tolerance() const { return tolerance_; }
+    const std::vector<uint8_t>& seating() const { return occupied[current]; }
+
+  private:
+    // Steps seats [i0, i1) from `from` into `to`, returning whether any changed
+    bool step_seats(const std::vector<uint8_t>& from, std::vector<uint8_t>& to, size_t i0, size_t i1) const {
+      uint8_t changed = 0;
+      for (size_t i = i0; i < i1; i++) {
+        int count = 0;
+        for (uint32_t e = offsets[i]; e < offsets[i + 1]; e++) {
+          count += from[neighbours[e]];
+        }
+        // Empty seats fill when no neighbour is occupied, occupied ones
+        // empty when `tolerance` or more are
+        const uint8_t next = from[i] ? count < tolerance_ : count == 0;
+        to[i] = next;
+        changed |= next ^ from[i];
+      }
+      return changed;
+    }
+
+  public:
+    template<typename F>
+    void for_each_neighbour(size_t i, F f) const {
+      for (uint32_t e = offsets[i]; e < offsets[i + 1]; e++) {
+        f(neighbours[e]);
+      }
+    }
+
+    bool iterate() {
+      const bool changed = step_seats(occupied[current], occupied[current ^ 1], 0, size());
+      current ^= 1;
+
+      return !changed;
+    }
+
+    // Like calling iterate() until it's stable or `limit` generations have
+    // changed something, returning how many did. Seats are numbered in row
+    // order, so each thread takes a band of rows as a contiguous range of
+    // seats. Line of sight reaches any distance, so there's no ghost zone
+    // to step several generations at once within, and the bands meet at a
+    // barrier after every generation instead.
+    size_t run(size_t threads, size_t limit) {
+      threads = std::clamp<size_t>(threads, 1, std::max<size_t>(1, size()));
+
+      Barrier barrier(threads);
+      std::vector<uint8_t> changes[2] = { std::vector<uint8_t>(threads), std::vector<uint8_t>(threads) };
+      const size_t start = current;
+      size_t generations = 0;
+
+      const auto worker = [&](size_t t) {
+        const size_t i0 = size() * t / threads;
+        const size_t i1 = size() * (t + 1) / threads;
+
+        size_t cur = start;
+        size_t changed = 0;
+        for (size_t g = 0; g < limit; g++) {
+          // Alternate between two sets of flags, so none is overwritten
+          // before every thread has read it
+          changes[g & 1][t] = step_seats(occupied[cur], occupied[cur ^ 1], i0, i1);
+          barrier.wait();
+
+          cur ^= 1;
+          if (std::find(changes[g & 1].begin(), changes[g & 1].end(), 1) == changes[g & 1].end()) {
+            break;
+          }
+          changed++;
+        }
+
+        if (t == 0) {
+          generations = changed;
+          current = cur;
+        }
+      };
+
+      std::vector<std::thread> workers;
+      for (size_t t = 1; t < threads; t++) {
+        workers.emplace_back(worker, t);
+      }
+      worker(0);
+      for (auto& w : workers) { w.join(); }
+
+      return generations;
+    }
+
+    size_t occupied_count() const {
+      return std::accumulate(occupied[current].begin(), occupied[current].end(), size_t(0));
+    }
+
+    bool matches(const FloorPlan& fp) const {
+      return SeatsMatch(occupied[current], fp);
+    }
+  };
+
+  // Runs a SeatGraph's rule over only the seats that might change: those
+  // which changed last generation, or had a neighbour change. Each seat
+  // also keeps a running count of its occupied neighbours, updated as they
+  // flip, so evaluating a seat is O(1) and a generation costs time in
+  // proportion to the activity rather than the number of seats.
+  class IncrementalSeating {
+  private:
+    const SeatGraph& graph;
+    std::vector<uint8_t> occupied;
+    std::vector<uint8_t> counts;
+    std::vector<uint32_t> dirty;
+    std::vector<uint32_t> flips;
+    // Generation each seat was last queued in, to keep `dirty` unique
+    std::vector<uint32_t> queued;
+    std::vector<size_t> changes;
+
+  public:
+    IncrementalSeating(const SeatGraph& g)
+      : graph(g)
+      , occupied(g.seating())
+      , counts(g.size(), 0)
+      , dirty(g.size())
+      , queued(g.size(), 0)
+    {
+      for (size_t i = 0; i < occupied.size(); i++) {
+        graph.for_each_neighbour(i, [&](uint32_t j) { counts[i] += occupied[j]; });
+      }
+      std::iota(dirty.begin(), dirty.end(), 0);
+    }
+
+    bool iterate() {
+      if (dirty.empty()) { return true; }
+
+      flips.clear();
+      for (const auto i : dirty) {
+        const bool next = occupied[i] ? counts[i] < graph.tolerance() : counts[i] == 0;
+        if (next != bool(occupied[i])) { flips.push_back(i); }
+      }
+
+      changes.push_back(flips.size());
+      const uint32_t generation = changes.size();
+      dirty.clear();
+      const auto queue = [&](uint32_t i) {
+        if (queued[i] != generation) {
+          queued[i] = generation;
+          dirty.push_back(i);
+        }
+      };
+      for (const auto i : flips) {
+        occupied[i] ^= 1;
+        const uint8_t delta = occupied[i] ? 1 : 0xff;
+        queue(i);
+        graph.for_each_neighbour(i, [&](uint32_t j) {
+          counts[j] += delta;
+          queue(j);
+        });
+      }
+
+      if (flips.empty()) {
+        changes.pop_back();
+        return true;
+      }
+      return false;
+    }
+
+    // Generations that changed at least one seat, and how many each changed
+    size_t generations() const { return changes.size(); }
+    const std::vector<size_t>& change_counts() const { return changes; }
+
+    size_t occupied_count() const {
+      return std::accumulate(occupied.begin(), occupied.end(), size_t(0));
+    }
+
+    bool matches(const FloorPlan& fp) const {
+      return SeatsMatch(occupied, fp);
+    }
+  };
+
   const auto LoadInput = [](auto f) {
     FloorPlan fp;
     std::string_view line;
@@ -246,9 +786,133 @@ L.LLLLL.LL)");
     fp.parse_done();
     return fp;
   };
+
+  // A square map with roughly one floor cell in eight
+  std::string GenerateFloorPlan(size_t size, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::string s;
+    s.reserve(size * (size + 1));
+    for (size_t y = 0; y < size; y++) {
+      for (size_t x = 0; x < size; x++) {
+        s += rng() % 8 ? 'L' : '.';
+      }
+      s += '\n';
+    }
+    return s;
+  }
+
+  // Runs a generated map through FloorPlan and the faster engines for both
+  // parts, checking they agree on the number of generations and the final
+  // seating. Random maps can settle into oscillation, so stop after `limit`.
+  template<typename Engine, typename Step>
+  void CheckEngine(const char* name, const FloorPlan& initial, Engine engine, Step step, size_t limit) {
+    FloorPlan fp = initial;
+    size_t generations = 0;
+    {
+      aoc::AutoTimer t("FloorPlan");
+      while (generations < limit && !step(fp)) { generations++; }
+    }
+
+    size_t engine_generations = 0;
+    {
+      aoc::AutoTimer t(name);
+      while (engine_generations < limit && !engine.iterate()) { engine_generations++; }
+    }
+
+    std::cout << name << ": " << generations << " generations, " << fp.occupied_count() << " occupied" << std::endl;
+    aoc::assert_result(engine_generations, generations);
+    aoc::assert_result(engine.occupied_count(), fp.occupied_count());
+    aoc::assert_result(engine.matches(fp), true);
+  }
+
+  int CheckAgainstFloorPlan(size_t size, uint32_t seed, size_t limit) {
+    const auto s = GenerateFloorPlan(size, seed);
+    const FloorPlan fp = LoadInput(std::string_view(s));
+
+    const auto part1 = [](FloorPlan& f) { return f.iterate(); };
+    const auto part2 = [](FloorPlan& f) { return f.iterate2(); };
+    const SeatGraph adjacent(fp, Visibility::Adjacent, 4);
+    const SeatGraph visible(fp, Visibility::LineOfSight, 5);
+
+    CheckEngine("PackedFloorPlan", fp, PackedFloorPlan(fp), part1, limit);
+    CheckEngine("SeatGraph (part 1)", fp, adjacent, part1, limit);
+    CheckEngine("SeatGraph (part 2)", fp, visible, part2, limit);
+    CheckEngine("IncrementalSeating (part 1)", fp, IncrementalSeating(adjacent), part1, limit);
+    CheckEngine("IncrementalSeating (part 2)", fp, IncrementalSeating(visible), part2, limit);
+
+    PackedFloorPlan serial(fp);
+    size_t generations = 0;
+    while (generations < limit && !serial.iterate()) { generations++; }
+    for (const size_t block : { 1, 5 }) {
+      PackedFloorPlan threaded(fp);
+      const size_t threaded_generations = threaded.run(4, block, limit);
+      std::cout << "PackedFloorPlan::run (4 threads, block " << block << ")" << std::endl;
+      aoc::assert_result(threaded_generations, generations);
+      aoc::assert_result(threaded.matches(serial), true);
+    }
+
+    // Both parts' SeatGraphs in bands, against FloorPlan
+    const std::tuple<const char*, const SeatGraph&, bool (*)(FloorPlan&)> graphs[] = {
+      { "part 1", adjacent, [](FloorPlan& f) { return f.iterate(); } },
+      { "part 2", visible, [](FloorPlan& f) { return f.iterate2(); } },
+    };
+    for (const auto& [name, graph, step] : graphs) {
+      FloorPlan reference = fp;
+      size_t expected = 0;
+      while (expected < limit && !step(reference)) { expected++; }
+
+      SeatGraph threaded = graph;
+      const size_t threaded_generations = threaded.run(4, limit);
+      std::cout << "SeatGraph::run (" << name << ", 4 threads)" << std::endl;
+      aoc::assert_result(threaded_generations, expected);
+      aoc::assert_result(threaded.matches(reference), true);
+    }
+
+    return 0;
+  }
+
+  // Times PackedFloorPlan::run on a generated map with 1 to 64 threads,
+  // checking each against a single threaded run without blocking
+  void BenchmarkThreads(size_t size, size_t generations, size_t block) {
+    const auto s = GenerateFloorPlan(size, 2020);
+    const FloorPlan fp = LoadInput(std::string_view(s));
+    PackedFloorPlan reference(fp);
+    const size_t expected = reference.run(1, 1, generations);
+
+    double base = 0;
+    for (size_t threads = 1; threads <= 64; threads *= 2) {
+      PackedFloorPlan packed(fp);
+      const auto start = std::chrono::high_resolution_clock::now();
+      const size_t g = packed.run(threads, block, generations);
+      const std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+      if (threads == 1) { base = elapsed.count(); }
+
+      std::cout << threads << " threads: " << elapsed.count() << " sec, " <<
+        (base / elapsed.count()) << "x" << std::endl;
+      if (g != expected || !packed.matches(reference)) {
+        std::cout << "Mismatch with " << threads << " threads" << std::endl;
+        exit(-1);
+      }
+    }
+  }
 }
 
 int main(int argc, char** argv) {
+  if (argc > 1 && BENCH_THREADS == argv[1]) {
+    const size_t size = argc > 2 ? aoc::stoi(argv[2]) : 4000;
+    const size_t generations = argc > 3 ? aoc::stoi(argv[3]) : 50;
+    const size_t block = argc > 4 ? aoc::stoi(argv[4]) : 1;
+    BenchmarkThreads(size, generations, block);
+    return 0;
+  }
+
+  if (argc > 1 && CHECK == argv[1]) {
+    const size_t size = argc > 2 ? aoc::stoi(argv[2]) : 1000;
+    const uint32_t seed = argc > 3 ? aoc::stoi(argv[3]) : 2020;
+    const size_t limit = argc > 4 ? aoc::stoi(argv[4]) : 100;
+    return CheckAgainstFloorPlan(size, seed, limit);
+  }
+
   aoc::AutoTimer t;
   const bool inTest = argc < 2;
 
@@ -261,20 +925,42 @@ int main(int argc, char** argv) {
     fp = LoadInput(f);
   }
 
-  // We'll need to start again with part2
-  FloorPlan fp2 = fp;
-  
-  while (!fp.iterate());
-  int part1 = fp.occupied_count();
+  PackedFloorPlan packed(fp);
+  while (!packed.iterate());
+  int part1 = packed.occupied_count();
 
-  while (!fp2.iterate2());
-  int part2 = fp2.occupied_count();
+  SeatGraph visible(fp, Visibility::LineOfSight, 5);
+  while (!visible.iterate());
+  int part2 = visible.occupied_count();
 
   aoc::print_results(part1, part2);
 
+  // Most of the seats in real inputs keep changing for most of the run, so
+  // the full passes above beat IncrementalSeating on time; it's used here
+  // for the per-generation activity.
+  if (argc > 2 && STATS == argv[2]) {
+    const SeatGraph graphs[] = {
+      { fp, Visibility::Adjacent, 4 },
+      { fp, Visibility::LineOfSight, 5 },
+    };
+    for (const auto& graph : graphs) {
+      IncrementalSeating seats(graph);
+      while (!seats.iterate());
+      std::cout << seats.generations() << " generations, changes:";
+      for (const auto& c : seats.change_counts()) {
+        std::cout << " " << c;
+      }
+      std::cout << std::endl;
+    }
+  }
+
   if (inTest) {
     aoc::assert_result(part1, SR_Part1);
     aoc::assert_result(part2, SR_Part2);
+
+    SeatGraph threaded(fp, Visibility::LineOfSight, 5);
+    threaded.run(4, SIZE_MAX);
+    aoc::assert_result(threaded.occupied_count(), size_t(SR_Part2));
   }
 
   return 0;
@@ -1,173 +1,331 @@
 #include "aoc/helpers.h"
 
+#include <array>
+#include <random>
+#include <thread>
 #include <vector>
 
 namespace {
-  using Result = std::pair<int, int>;
+  using Result = std::pair<int64_t, int64_t>;
   using MappedFileSource = aoc::MappedFileSource<char>;
 
+  STRING_CONSTANT(AT, "at");
+  STRING_CONSTANT(BENCH_ROUTE, "bench-route");
+
   constexpr std::string_view SampleInput(R"(F10
 N3
 F7
 R90
 F11)");
-  constexpr int SR_Part1 = 25;
-  constexpr int SR_Part2 = 286;
+  constexpr int64_t SR_Part1 = 25;
+  constexpr int64_t SR_Part2 = 286;
+
+  // Points are Gaussian integers, x + yi, so that turning left by 90
+  // degrees is multiplying by i, and moving forwards is adding a multiple
+  // of the heading.
+  struct Gaussian {
+    int64_t re;
+    int64_t im;
 
-  using Point = aoc::Point;
+    Gaussian operator+(const Gaussian& o) const {
+      return { re + o.re, im + o.im };
+    }
+
+    Gaussian operator*(const Gaussian& o) const {
+      return { re * o.re - im * o.im, re * o.im + im * o.re };
+    }
 
-  enum class Direction {
-    North,
-    East,
-    South,
-    West,
+    int64_t manhattan() const {
+      return std::abs(re) + std::abs(im);
+    }
   };
 
-  const std::vector<Direction> DirectionSet = {
-    Direction::North,
-    Direction::South,
-    Direction::West,
-    Direction::East,
+  // i^0..i^3, a quarter turn left each
+  constexpr std::array<Gaussian, 4> QuarterTurns = {{
+    { 1, 0 }, { 0, 1 }, { -1, 0 }, { 0, -1 },
+  }};
+
+  // The ship's position, and the vector F moves it along: its heading for
+  // part 1 and the waypoint for part 2.
+  struct State {
+    Gaussian ship;
+    Gaussian vector;
   };
 
-  std::ostream& operator<<(std::ostream& os, const Direction& d) {
-    switch (d) {
-      case Direction::North:
-        os << "N";
-        break;
-      case Direction::South:
-        os << "S";
-        break;
-      case Direction::East:
-        os << "E";
-        break;
-      case Direction::West:
-        os << "W";
-        break;
-    }
+  std::ostream& operator<<(std::ostream& os, const State& s) {
+    os << s.ship.re << ", " << s.ship.im;
     return os;
   }
 
-  const std::vector<Point> Directions = {
-      {  0,  1 },
-      {  1,  0 },
-      {  0, -1 },
-      { -1,  0 },
-  };
+  // Every instruction, and any run of them, is the affine map
+  //   vector' = turn * vector + shift
+  //   ship'   = ship + forward * vector + offset
+  // i.e. the 3x3 matrix [[1, forward, offset], [0, turn, shift], [0, 0, 1]]
+  // over the Gaussian integers acting on (ship, vector, 1).
+  struct Transform {
+    Gaussian turn{ 1, 0 };
+    Gaussian shift{ 0, 0 };
+    Gaussian forward{ 0, 0 };
+    Gaussian offset{ 0, 0 };
 
-  const auto turn_left = [](Direction dir) {
-    const int val = static_cast<int>(dir);
-    return static_cast<Direction>((val + 3) & 3);
+    State apply(const State& s) const {
+      return { s.ship + forward * s.vector + offset, turn * s.vector + shift };
+    }
+
+    // This, then `next`
+    Transform then(const Transform& next) const {
+      return {
+        next.turn * turn,
+        next.turn * shift + next.shift,
+        forward + next.forward * turn,
+        offset + next.forward * shift + next.offset,
+      };
+    }
   };
 
-  const auto turn_right = [](Direction dir) {
-    const int val = static_cast<int>(dir);
-    return static_cast<Direction>((val + 1) & 3);
+  struct Instruction {
+    char action;
+    int32_t value;
   };
 
-  const auto rotate_left = [](Point p) {
-    return Point{ -p.second, p.first };
+  using Input = std::vector<Instruction>;
+
+  enum class Part {
+    // N/S/E/W move the ship
+    Ship,
+    // N/S/E/W move the waypoint
+    Waypoint,
   };
 
-  const auto rotate_right = [](Point p) {
-    return Point{ p.second, -p.first };
+  Transform Compile(const Instruction& ins, Part part) {
+    Transform t;
+    Gaussian& moves = part == Part::Ship ? t.offset : t.shift;
+    switch (ins.action) {
+      case 'N':
+        moves = { 0, ins.value };
+        break;
+      case 'S':
+        moves = { 0, -ins.value };
+        break;
+      case 'E':
+        moves = { ins.value, 0 };
+        break;
+      case 'W':
+        moves = { -ins.value, 0 };
+        break;
+      case 'F':
+        t.forward = { ins.value, 0 };
+        break;
+      case 'L':
+        t.turn = QuarterTurns[(ins.value / 90) & 3];
+        break;
+      case 'R':
+        t.turn = QuarterTurns[(4 - (ins.value / 90 & 3)) & 3];
+        break;
+      default:
+        throw std::runtime_error("Bad Input");
+    }
+    return t;
+  }
+
+  const State Initial[] = {
+    // Facing east
+    { { 0, 0 }, { 1, 0 } },
+    // Waypoint 10 east, 1 north
+    { { 0, 0 }, { 10, 1 } },
   };
 
-  const auto LoadInput = [](auto f) {
-    Result r{0, 0};
-    std::string_view line;
+  // Prefix transforms at every `Spacing` instructions for both parts, so the
+  // state after any instruction is a checkpoint plus at most Spacing - 1
+  // instructions, whatever the length of the route.
+  class Route {
+  private:
+    static constexpr size_t Spacing = 64;
 
-    Point pos{0, 0};
-    Direction dir = Direction::East;
+    const Input& instructions;
+    // checkpoints[p][j] is the first j * Spacing instructions for part p
+    std::vector<Transform> checkpoints[2];
 
-    Point wp{10, 1};
-    Point ship{0, 0};
+  public:
+    // Built as a parallel scan: each thread composes its chunk of whole
+    // checkpoint blocks, the chunk totals are scanned in order, and then
+    // each thread fills in its chunk's checkpoints from its starting prefix.
+    Route(const Input& input, size_t threads)
+      : instructions(input)
+    {
+      const size_t blocks = input.size() / Spacing + 1;
+      threads = std::max<size_t>(1, std::min(threads, blocks));
 
-    while (aoc::getline(f, line)) {
-      assert(line.size() > 1);
-      if (line.size() < 2) { throw std::runtime_error("Invalid input"); }
+      const auto block_of = [&](size_t t) { return blocks * t / threads; };
+      const auto compose = [&](Transform prefix, Part part, size_t from, size_t to) {
+        for (size_t i = from; i < to; i++) {
+          prefix = prefix.then(Compile(input[i], part));
+        }
+        return prefix;
+      };
+
+      const auto parallel = [threads](auto f) {
+        std::vector<std::thread> workers;
+        for (size_t t = 1; t < threads; t++) {
+          workers.emplace_back(f, t);
+        }
+        f(0);
+        for (auto& w : workers) { w.join(); }
+      };
+
+      const auto end_of = [&](size_t t) {
+        return std::min(input.size(), block_of(t + 1) * Spacing);
+      };
 
-      const char action = line[0];
-      const int value = aoc::stoi(line.substr(1));
-
-      switch (action) {
-        case 'N':
-          pos.second += value;
-          wp.second += value;
-          break;
-        case 'S':
-          pos.second -= value;
-          wp.second -= value;
-          break;
-        case 'E':
-          pos.first += value;
-          wp.first += value;
-          break;
-        case 'W':
-          pos.first -= value;
-          wp.first -= value;
-          break;
-        case 'F':
-          pos.first += (Directions[static_cast<int>(dir)].first * value);
-          pos.second += (Directions[static_cast<int>(dir)].second * value);
-
-          ship.first += wp.first * value;
-          ship.second += wp.second * value;
-          break;
-        case 'R':
-          {
-            int rotations = value / 90;
-            while (rotations) {
-              dir = turn_right(dir);
-              wp = rotate_right(wp);
-              rotations--;
-            }
+      // The last chunk's total is never needed
+      std::vector<Transform> totals[2];
+      for (auto& t : totals) { t.resize(threads); }
+      parallel([&](size_t t) {
+        if (t + 1 == threads) { return; }
+        for (const auto part : { Part::Ship, Part::Waypoint }) {
+          totals[int(part)][t] = compose(Transform{}, part, block_of(t) * Spacing, end_of(t));
+        }
+      });
+
+      for (auto& c : checkpoints) { c.resize(blocks); }
+      parallel([&](size_t t) {
+        for (const auto part : { Part::Ship, Part::Waypoint }) {
+          Transform prefix;
+          for (size_t u = 0; u < t; u++) {
+            prefix = prefix.then(totals[int(part)][u]);
           }
-          break;
-        case 'L':
-          {
-            int rotations = value / 90;
-            while (rotations) {
-              dir = turn_left(dir);
-              wp = rotate_left(wp);
-              rotations--;
-            }
+          for (size_t b = block_of(t); b < block_of(t + 1); b++) {
+            checkpoints[int(part)][b] = prefix;
+            prefix = compose(prefix, part, b * Spacing, std::min(input.size(), (b + 1) * Spacing));
           }
-          break;
-        default:
-          throw std::runtime_error("Bad Input");
+        }
+      });
+    }
+
+    size_t size() const { return instructions.size(); }
+
+    // The state once the first `n` instructions have been followed
+    State at(size_t n, Part part) const {
+      n = std::min(n, instructions.size());
+      State s = checkpoints[int(part)][n / Spacing].apply(Initial[int(part)]);
+      for (size_t i = n - n % Spacing; i < n; i++) {
+        s = Compile(instructions[i], part).apply(s);
       }
-      DEBUG_PRINT(action << ":" << value << " -> " << pos.first << ", " << pos.second << " " << dir);
-      DEBUG_PRINT(action << ":" << value << " WP -> " << wp.first << ", " << wp.second << " Ship -> " << ship.first << ", " << ship.second);
+      return s;
     }
+  };
 
-    r.first = std::abs(pos.first) + std::abs(pos.second);
-    r.second = std::abs(ship.first) + std::abs(ship.second);
+  const auto LoadInput = [](auto f) {
+    Input r;
+    std::string_view line;
+    while (aoc::getline(f, line)) {
+      assert(line.size() > 1);
+      if (line.size() < 2) { throw std::runtime_error("Invalid input"); }
 
+      const Instruction ins{ line[0], int32_t(aoc::stoi(line.substr(1))) };
+      if ((ins.action == 'L' || ins.action == 'R') && ins.value % 90) {
+        throw std::runtime_error("Bad Input");
+      }
+      r.push_back(ins);
+    }
     return r;
   };
+
+  const auto Navigate = [](const Route& route) {
+    return Result{
+      route.at(route.size(), Part::Ship).ship.manhattan(),
+      route.at(route.size(), Part::Waypoint).ship.manhattan(),
+    };
+  };
+
+  // Builds the index over `n` random instructions and checks random queries
+  // against following the instructions one at a time
+  void BenchmarkRoute(size_t n, size_t queries) {
+    std::mt19937 rng(2020);
+    Input input(n);
+    for (auto& ins : input) {
+      ins.action = "NSEWLRF"[rng() % 7];
+      ins.value = ins.action == 'L' || ins.action == 'R' ? 90 * (1 + rng() % 3) : 1 + rng() % 100;
+    }
+
+    const auto start = std::chrono::high_resolution_clock::now();
+    const Route route(input, std::thread::hardware_concurrency());
+    const std::chrono::duration<double> built = std::chrono::high_resolution_clock::now() - start;
+
+    std::vector<size_t> at(queries);
+    for (auto& q : at) { q = rng() % (n + 1); }
+    std::sort(at.begin(), at.end());
+
+    const auto query_start = std::chrono::high_resolution_clock::now();
+    int64_t checksum = 0;
+    for (const auto& q : at) {
+      checksum += route.at(q, Part::Waypoint).ship.re;
+    }
+    const std::chrono::duration<double> queried = std::chrono::high_resolution_clock::now() - query_start;
+
+    std::cout << n << " instructions: index built in " << built.count() << " sec, " <<
+      queries << " queries in " << queried.count() << " sec (checksum " << checksum << ")" << std::endl;
+
+    State s[2] = { Initial[0], Initial[1] };
+    size_t q = 0;
+    for (size_t i = 0; i <= n; i++) {
+      for (; q < at.size() && at[q] == i; q++) {
+        for (const auto part : { Part::Ship, Part::Waypoint }) {
+          const auto& expected = s[int(part)];
+          const auto got = route.at(i, part);
+          if (got.ship.re != expected.ship.re || got.ship.im != expected.ship.im) {
+            std::cout << "Mismatch after " << i << " instructions: " << got << " != " << expected << std::endl;
+            exit(-1);
+          }
+        }
+      }
+      if (i < n) {
+        for (const auto part : { Part::Ship, Part::Waypoint }) {
+          s[int(part)] = Compile(input[i], part).apply(s[int(part)]);
+        }
+      }
+    }
+    std::cout << "All queries match" << std::endl;
+  }
 }
 
 int main(int argc, char** argv) {
+  if (argc > 1 && BENCH_ROUTE == argv[1]) {
+    const size_t n = argc > 2 ? aoc::stoi(argv[2]) : 5000000;
+    BenchmarkRoute(n, 1000000);
+    return 0;
+  }
+
   aoc::AutoTimer t;
   const bool inTest = argc < 2;
 
-  Result r;
+  Input input;
   if (inTest) {
-    r = LoadInput(SampleInput);
+    input = LoadInput(SampleInput);
   } else {
     std::unique_ptr<MappedFileSource>m(new MappedFileSource(argc, argv));
     std::string_view f(m->data(), m->size());
-    r = LoadInput(f);
+    input = LoadInput(f);
   }
 
-  int part1 = 0;
-  int part2 = 0;
+  const Route route(input, std::thread::hardware_concurrency());
+  Result r = Navigate(route);
+
+  int64_t part1 = 0;
+  int64_t part2 = 0;
 
   std::tie(part1, part2) = r;
 
   aoc::print_results(part1, part2);
 
+  if (argc > 2 && AT == argv[2]) {
+    for (int i = 3; i < argc; i++) {
+      const size_t n = std::stoull(argv[i]);
+      std::cout << "After " << n << ": ship " << route.at(n, Part::Ship) <<
+        ", waypoint ship " << route.at(n, Part::Waypoint) << std::endl;
+    }
+  }
+
   if (inTest) {
     aoc::assert_result(part1, SR_Part1);
     aoc::assert_result(part2, SR_Part2);
@@ -175,4 +333,3 @@ int main(int argc, char** argv) {
 
   return 0;
 }
-
@@ -1,5 +1,8 @@
 #include "aoc/helpers.h"
+#include "aoc/bigint.h"
 
+#include <optional>
+#include <random>
 #include <vector>
 #include <numeric>
 
@@ -7,12 +10,29 @@ namespace {
   using Result = std::pair<int, int>;
   using MappedFileSource = aoc::MappedFileSource<char>;
 
+  STRING_CONSTANT(BATCH, "batch");
+  STRING_CONSTANT(BENCH_CRT, "bench-crt");
+
   constexpr std::string_view SampleInput(R"(939
 7,13,x,x,59,x,31,19)");
   constexpr int SR_Part1 = 295;
-  constexpr int SR_Part2 = 1068781;
+  constexpr uint64_t SR_Part2 = 1068781;
+
+  // Bus IDs by position, 0 for out of service
+  using Schedule = std::vector<int64_t>;
+  using Input = std::pair<int, Schedule>;
 
-  using Input = std::pair<int, std::vector<int>>;
+  const auto ParseSchedule = [](std::string_view line) {
+    Schedule schedule;
+    std::string_view bus;
+    while (aoc::getline(line, bus, ",")) {
+      constexpr std::string_view OOS("x");
+      const int64_t bus_id = bus == OOS ? 0 : aoc::stoi(bus);
+      schedule.push_back(bus_id);
+      DEBUG_PRINT("Bus ID: " << bus_id);
+    }
+    return schedule;
+  };
 
   const auto LoadInput = [](auto f) {
     Input input;
@@ -21,12 +41,8 @@ namespace {
     input.first = aoc::stoi(line);
     DEBUG_PRINT("Departure: " << input.first);
 
-    while (aoc::getline(f, line, ",")) {
-      constexpr std::string_view OOS("x");
-      const int bus_id = line == OOS ? 0 : aoc::stoi(line);
-      input.second.push_back(bus_id);
-      DEBUG_PRINT("Bus ID: " << bus_id);
-    }
+    aoc::getline(f, line);
+    input.second = ParseSchedule(line);
 
     return input;
   };
@@ -52,50 +68,168 @@ namespace {
     return wait * earliest;
   };
 
-  using Constraint = std::pair<int64_t, int64_t>;
-  using Constraints = std::vector<Constraint>;
-  using GCD = std::tuple<int64_t, int64_t, int64_t>;
+  using Int128 = __int128;
+  using BigUint = aoc::BigUint;
 
-  std::ostream& operator<<(std::ostream& os, const Constraint& c) {
-    os << "{ " << c.first << ", " << c.second << " }";
-    return os;
-  }
+  // a * x + b * y = gcd
+  struct Euclid {
+    Int128 gcd;
+    Int128 x;
+    Int128 y;
+  };
 
-  std::ostream& operator<<(std::ostream& os, const GCD& c) {
-    os << "{ " << std::get<0>(c) << ", " << std::get<1>(c) << ", " << std::get<2>(c) << " }";
-    return os;
+  Euclid ExtendedGcd(Int128 a, Int128 b) {
+    Int128 old_r = a, r = b;
+    Int128 old_s = 1, s = 0;
+    Int128 old_t = 0, t = 1;
+    while (r) {
+      const Int128 q = old_r / r;
+      std::tie(old_r, r) = std::make_pair(r, old_r - q * r);
+      std::tie(old_s, s) = std::make_pair(s, old_s - q * s);
+      std::tie(old_t, t) = std::make_pair(t, old_t - q * t);
+    }
+    return { old_r, old_s, old_t };
   }
 
-  const auto FindEarliestOffset = [](const Input& input) {
+  // Folds congruences t = r (mod m) one at a time into the single one
+  // t = residue (mod modulus), where modulus is the lcm of the moduli so
+  // far, so they needn't be coprime. The combined modulus soon outgrows 64
+  // bits, so it's a BigUint, but everything done modulo the new m fits in
+  // __int128 as long as m < 2^63.
+  class CrtSolver {
+  private:
+    BigUint residue;
+    BigUint modulus;
+    bool consistent;
+
+  public:
+    CrtSolver()
+      : residue(0)
+      , modulus(1)
+      , consistent(true)
+    { }
+
+    // Returns false, and stays false, once the congruences contradict
+    // each other
+    bool add(uint64_t r, uint64_t m) {
+      assert(m > 0 && m < (uint64_t(1) << 63) && r < m);
+      if (!consistent) { return false; }
+
+      // residue + modulus * k = r (mod m) needs modulus * k = r - residue,
+      // solvable only if gcd(modulus, m) divides the difference
+      const Int128 mm = modulus.mod(m);
+      const Int128 g = ExtendedGcd(mm, m).gcd;
+      const Int128 diff = (Int128(r) - Int128(residue.mod(m)) + m) % m;
+      if (diff % g) {
+        consistent = false;
+        return false;
+      }
 
-    size_t time = 0;
-    size_t step = 1;
+      // Then k = (diff / g) * inverse(modulus / g) mod (m / g)
+      const Int128 m_g = m / g;
+      Int128 inverse = ExtendedGcd(mm / g % m_g, m_g).x % m_g;
+      if (inverse < 0) { inverse += m_g; }
+      const Int128 k = (diff / g) % m_g * inverse % m_g;
 
-    // convert input into constraints
-    Constraints constraints;
-    for (size_t i = 0; i < input.second.size(); i++) {
-      if (!input.second[i]) { continue; }
-      constraints.push_back({i, input.second[i]});
-      DEBUG_PRINT("Constraint: " << constraints.back());
+      residue += modulus * BigUint(uint64_t(k));
+      modulus *= BigUint(uint64_t(m_g));
+      return true;
     }
 
-    for (const auto &b : constraints) {
-      while ((time + b.first) % b.second != 0) { time += step; }
+    bool is_consistent() const { return consistent; }
 
-      step *= b.second;
+    // The smallest non-negative solution
+    std::optional<BigUint> solution() const {
+      if (!consistent) { return std::nullopt; }
+      return residue;
     }
-
-    return time;
   };
+
+  // The earliest time t at which each bus departs its position in the
+  // schedule after t, or nothing if no such time exists
+  std::optional<BigUint> FindEarliestOffset(const Schedule& schedule) {
+    CrtSolver crt;
+    for (size_t i = 0; i < schedule.size(); i++) {
+      const uint64_t bus = schedule[i];
+      if (!bus) { continue; }
+      // t + i = 0 (mod bus)
+      if (!crt.add((bus - i % bus) % bus, bus)) { break; }
+    }
+    return crt.solution();
+  }
+
+  std::vector<std::optional<BigUint>> FindEarliestOffsets(const std::vector<Schedule>& schedules) {
+    std::vector<std::optional<BigUint>> r;
+    r.reserve(schedules.size());
+    for (const auto& s : schedules) {
+      r.push_back(FindEarliestOffset(s));
+    }
+    return r;
+  }
+
+  // Solves a schedule of `n` distinct primes just under 2^31 and checks
+  // the answer against every bus
+  void BenchmarkCrt(size_t n) {
+    const auto is_prime = [](uint64_t p) {
+      for (uint64_t d = 2; d * d <= p; d++) {
+        if (p % d == 0) { return false; }
+      }
+      return true;
+    };
+
+    std::mt19937 rng(2020);
+    Schedule schedule;
+    for (uint64_t p = (uint64_t(1) << 31) - 1; schedule.size() < n; p -= 2) {
+      if (!is_prime(p)) { continue; }
+      for (size_t gap = rng() % 4; gap; gap--) { schedule.push_back(0); }
+      schedule.push_back(p);
+    }
+
+    const auto start = std::chrono::high_resolution_clock::now();
+    const auto t = FindEarliestOffset(schedule);
+    const std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+
+    const auto digits = t->to_string().size();
+    std::cout << n << " buses: " << digits << " digit answer in " << elapsed.count() << " sec" << std::endl;
+    for (size_t i = 0; i < schedule.size(); i++) {
+      if (schedule[i] && (*t + BigUint(i)).mod(schedule[i])) {
+        std::cout << "Bus " << schedule[i] << " at " << i << " doesn't depart" << std::endl;
+        exit(-1);
+      }
+    }
+    std::cout << "All buses depart on time" << std::endl;
+  }
 }
 
 int main(int argc, char** argv) {
+  if (argc > 1 && BENCH_CRT == argv[1]) {
+    BenchmarkCrt(argc > 2 ? aoc::stoi(argv[2]) : 500);
+    return 0;
+  }
+
   aoc::AutoTimer t;
   const bool inTest = argc < 2;
 
   Input input;
   if (inTest) {
     input = LoadInput(SampleInput);
+  } else if (argc > 2 && BATCH == argv[2]) {
+    // One schedule per line
+    std::unique_ptr<MappedFileSource>m(new MappedFileSource(argc, argv));
+    std::string_view f(m->data(), m->size());
+    std::vector<Schedule> schedules;
+    std::string_view line;
+    while (aoc::getline(f, line)) {
+      schedules.push_back(ParseSchedule(line));
+    }
+    for (const auto& r : FindEarliestOffsets(schedules)) {
+      if (r) {
+        std::cout << *r << std::endl;
+      } else {
+        std::cout << "inconsistent" << std::endl;
+      }
+    }
+    return 0;
   } else {
     std::unique_ptr<MappedFileSource>m(new MappedFileSource(argc, argv));
     std::string_view f(m->data(), m->size());
@@ -103,15 +237,19 @@ int main(int argc, char** argv) {
   }
 
   int part1 = FindEarliest(input);
-  int64_t part2 = FindEarliestOffset(input);
+  BigUint part2 = FindEarliestOffset(input.second).value_or(0);
 
   aoc::print_results(part1, part2);
 
   if (inTest) {
     aoc::assert_result(part1, SR_Part1);
     aoc::assert_result(part2, SR_Part2);
+
+    // Shared factors: t = 0 (mod 6) and t + 2 = 0 (mod 4) meet at 6, but
+    // t + 3 = 0 (mod 4) needs t odd
+    aoc::assert_result(FindEarliestOffset({ 6, 0, 4 }).value_or(0), BigUint(6));
+    aoc::assert_result(FindEarliestOffset({ 6, 0, 0, 4 }).has_value(), false);
   }
 
   return 0;
 }
-
@@ -1,210 +1,518 @@
 #include "aoc/helpers.h"
+#include "aoc/bigint.h"
 
-#include <array>
+#include <algorithm>
 #include <iterator>
 #include <numeric>
+#include <optional>
+#include <random>
+#include <thread>
 #include <vector>
 #include <unordered_map>
 
 namespace {
-  using Result = std::pair<int64_t, int64_t>;
   using MappedFileSource = aoc::MappedFileSource<char>;
 
+  STRING_CONSTANT(BENCH_FLOATING, "bench-floating");
+  STRING_CONSTANT(BENCH_LOG, "bench-log");
+
   constexpr std::string_view SampleInput(R"(mask = 000000000000000000000000000000X1001X
 mem[42] = 100
 mask = 00000000000000000000000000000000X0XX
 mem[26] = 1)");
   constexpr int SR_Part1 = 51;
-  constexpr int SR_Part2 = 208;
+  constexpr uint64_t SR_Part2 = 208;
+
+  using Memory = std::unordered_map<uint64_t, uint64_t>;
 
-  using MaskPair = std::pair<bool, bool>;
-  using CurrentMask = std::vector<MaskPair>;
-  using Memory = std::unordered_map<int64_t, int64_t>;
-  using BinaryNum = std::array<bool, 36>;
-  using MemMaskSet = std::vector<int64_t>;
+  constexpr size_t AddressBits = 36;
 
-  std::ostream& operator <<(std::ostream& os, const CurrentMask& x) {
-    for (auto it = x.begin(); it != x.end(); it++) {
-      if (!it->first) { os << "X"; }
-      else { os << it->second; }
+  // A `mask = ` line, compiled once into the bits it sets and the bits
+  // left floating; the rest it clears
+  struct Mask {
+    uint64_t ones;
+    uint64_t floating;
+
+    // Part 1: the value's bits under an X survive, the rest come from
+    // the mask, so `floating` doubles as the and mask
+    uint64_t apply(uint64_t value) const {
+      return (value & floating) | ones;
+    }
+
+    // Part 2's address with every floating bit cleared, so any submask
+    // of `floating` can be or'd in
+    uint64_t base_address(uint64_t address) const {
+      return (address | ones) & ~floating;
+    }
+  };
+
+  std::ostream& operator <<(std::ostream& os, const Mask& m) {
+    for (size_t i = AddressBits; i-- > 0; ) {
+      const uint64_t bit = uint64_t(1) << i;
+      os << ((m.floating & bit) ? 'X' : (m.ones & bit) ? '1' : '0');
     }
     return os;
   }
 
-  std::ostream& operator <<(std::ostream& os, const BinaryNum& x) {
-    for (const auto& it : x) {
-      os << it;
+  const auto ParseMask = [](std::string_view bits) {
+    assert(bits.size() == AddressBits);
+    if (bits.size() != AddressBits) { throw std::runtime_error("Invalid input"); }
+
+    Mask m{ 0, 0 };
+    for (const auto& c : bits) {
+      m.ones <<= 1;
+      m.floating <<= 1;
+      switch (c) {
+        case 'X':
+          m.floating |= 1;
+          break;
+        case '1':
+          m.ones |= 1;
+          break;
+        case '0':
+          break;
+        default:
+          throw std::runtime_error("Invalid input");
+      }
+    }
+    return m;
+  };
+
+  struct Write {
+    uint64_t address;
+    uint64_t value;
+    // Index into Program::masks
+    uint32_t mask;
+  };
+
+  struct Program {
+    std::vector<Mask> masks;
+    std::vector<Write> writes;
+  };
+
+  // Calls f(address) for every address a part 2 write touches: each
+  // submask of the floating bits, from all of them down to none
+  template<typename F>
+  void ForEachAddress(const Mask& mask, uint64_t address, F f) {
+    const uint64_t base = mask.base_address(address);
+    for (uint64_t s = mask.floating; ; s = (s - 1) & mask.floating) {
+      f(base | s);
+      if (!s) { break; }
     }
-    return os;
   }
 
-  const auto ToBinaryNum = [](const int64_t in) {
-    BinaryNum b;
-    b.fill(false);
-    int64_t val = in;
-    for (size_t i = 0; i < b.max_size(); i++) {
-      const bool r = val & 1;
-      val >>= 1;
-      b[i] = r;
-    }
-    DEBUG_PRINT(in << " -> " << b);
-    return b;
+  const auto SumMemory = [](const Memory& mem) {
+    return std::accumulate(mem.begin(), mem.end(), uint64_t(0), [](const auto& s, const auto& v) { return s + v.second; });
   };
 
-  const auto ApplyMask = [](const CurrentMask& mask, int64_t val) {
-    BinaryNum bn = ToBinaryNum(val);
+  const auto RunPart1 = [](const Program& program) {
+    Memory mem;
+    for (const auto& w : program.writes) {
+      mem[w.address] = program.masks[w.mask].apply(w.value);
+    }
+    return SumMemory(mem);
+  };
 
-    assert(mask.size() == 36);
-    for (size_t i = 0; i < bn.size(); i++) {
-      if (mask[i].first) { bn[i] = mask[i].second; }
+  // Part 2 by writing every address each write touches into a hash map
+  const auto RunPart2Expanded = [](const Program& program) {
+    Memory mem;
+    for (const auto& w : program.writes) {
+      ForEachAddress(program.masks[w.mask], w.address, [&](uint64_t a) {
+        DEBUG_PRINT("mem[" << a << "] = " << w.value);
+        mem[a] = w.value;
+      });
     }
+    return SumMemory(mem);
+  };
 
-    int64_t out = 0;
-    int64_t base = 1;
-    for (size_t i = 0; i < bn.size(); i++) {
-      if (bn[i]) { out += base; }
-      base *= 2;
+  // Part 2 sums can outgrow 64 bits, so they're kept in 128 and handed
+  // out as a BigUint
+  aoc::BigUint ToBigUint(unsigned __int128 v) {
+    const aoc::BigUint high(uint64_t(v >> 64));
+    return high * aoc::BigUint(uint64_t(1) << 32) * aoc::BigUint(uint64_t(1) << 32) + aoc::BigUint(uint64_t(v));
+  }
+
+  // Part 2 by expansion into a flat log rather than a hash map. Every
+  // address a write touches is appended with the write's index, the log is
+  // radix sorted on the address, and the last entry for each address wins.
+  // The log is filled in write order and each pass is a stable counting
+  // sort, so entries for one address stay in write order.
+  class WriteLog {
+  private:
+    static constexpr size_t SeqBits = 64 - AddressBits;
+    static constexpr uint64_t SeqMask = (uint64_t(1) << SeqBits) - 1;
+    static constexpr size_t DigitBits = 12;
+    static constexpr size_t Buckets = size_t(1) << DigitBits;
+
+    const Program& program;
+    size_t threads;
+    // address << SeqBits | index into program.writes
+    std::vector<uint64_t> log;
+
+    // Calls f(t, from, to) for `threads` even slices of [0, n)
+    template<typename F>
+    void parallel(size_t n, F f) const {
+      std::vector<std::thread> workers;
+      for (size_t t = 1; t < threads; t++) {
+        workers.emplace_back(f, t, n * t / threads, n * (t + 1) / threads);
+      }
+      f(0, 0, n / threads);
+      for (auto& w : workers) { w.join(); }
     }
 
-    DEBUG_PRINT(val << " & " << mask << ": " << bn << " -> " << out);
+    void append() {
+      std::vector<size_t> offsets(program.writes.size() + 1, 0);
+      for (size_t i = 0; i < program.writes.size(); i++) {
+        offsets[i + 1] = offsets[i] + (size_t(1) << __builtin_popcountll(program.masks[program.writes[i].mask].floating));
+      }
 
-    return out;
-  };
+      log.resize(offsets.back());
+      parallel(program.writes.size(), [&](size_t, size_t from, size_t to) {
+        for (size_t i = from; i < to; i++) {
+          const auto& w = program.writes[i];
+          size_t at = offsets[i];
+          ForEachAddress(program.masks[w.mask], w.address, [&](uint64_t a) {
+            log[at++] = a << SeqBits | i;
+          });
+        }
+      });
+    }
+
+    void sort() {
+      // Digits no two addresses differ in are already sorted
+      uint64_t varying = 0;
+      for (const auto& e : log) {
+        varying |= e ^ log.front();
+      }
+
+      std::vector<uint64_t> scratch(log.size());
+      std::vector<size_t> counts(threads * Buckets);
+      for (size_t shift = SeqBits; shift < 64; shift += DigitBits) {
+        if (!((varying >> shift) & (Buckets - 1))) { continue; }
+
+        std::fill(counts.begin(), counts.end(), 0);
+        parallel(log.size(), [&](size_t t, size_t from, size_t to) {
+          size_t* count = &counts[t * Buckets];
+          for (size_t i = from; i < to; i++) {
+            count[(log[i] >> shift) & (Buckets - 1)]++;
+          }
+        });
+
+        // Bucket by bucket, then thread by thread, keeps the pass stable
+        size_t total = 0;
+        for (size_t b = 0; b < Buckets; b++) {
+          for (size_t t = 0; t < threads; t++) {
+            const auto n = counts[t * Buckets + b];
+            counts[t * Buckets + b] = total;
+            total += n;
+          }
+        }
+
+        parallel(log.size(), [&](size_t t, size_t from, size_t to) {
+          size_t* next = &counts[t * Buckets];
+          for (size_t i = from; i < to; i++) {
+            scratch[next[(log[i] >> shift) & (Buckets - 1)]++] = log[i];
+          }
+        });
+        log.swap(scratch);
+      }
+    }
 
-  const auto GenerateMaskSet = [](int64_t& address, const CurrentMask& mask) {
-    MemMaskSet r;
-
-    int64_t addr = 0;
-    int64_t base = 1;
-    for (const auto& i : mask) {
-      if (i.first && i.second) { // 1
-        addr += base;
-      } else if (!i.first && !i.second) { // X
-        r.push_back(base);
-      } else {
-        addr += (address & base) ? base : 0;
+  public:
+    WriteLog(const Program& p, size_t t)
+      : program(p)
+      , threads(std::max<size_t>(1, t))
+    {
+      assert(program.writes.size() <= SeqMask);
+      if (program.writes.size() > SeqMask) { throw std::runtime_error("Too many writes"); }
+      // Masks are only ever AddressBits wide, so this covers every address
+      // a write touches, and none loses its top bits to the sequence
+      for (const auto& w : program.writes) {
+        assert(!(w.address >> AddressBits));
+        if (w.address >> AddressBits) { throw std::runtime_error("Address out of range"); }
       }
 
-      base *= 2;
+      append();
+      sort();
     }
 
-    DEBUG_PRINT("In: " << address << " Out: " << addr << " Mask: " << mask << " Perms: " << r.size());
+    size_t size() const { return log.size(); }
 
-    address = addr;
+    aoc::BigUint sum() const {
+      std::vector<unsigned __int128> sums(threads, 0);
+      parallel(log.size(), [&](size_t t, size_t from, size_t to) {
+        unsigned __int128 s = 0;
+        for (size_t i = from; i < to; i++) {
+          if (i + 1 == log.size() || (log[i + 1] >> SeqBits) != (log[i] >> SeqBits)) {
+            s += program.writes[log[i] & SeqMask].value;
+          }
+        }
+        sums[t] = s;
+      });
+      return ToBigUint(std::accumulate(sums.begin(), sums.end(), static_cast<unsigned __int128>(0)));
+    }
+  };
 
-    return r;
+  const auto RunPart2Log = [](const Program& program) {
+    return WriteLog(program, std::thread::hardware_concurrency()).sum();
   };
 
-  void ApplyMemMask(size_t depth, int64_t address, const MemMaskSet& maskSet, Memory& mem, int64_t val) {
-    const int64_t base = maskSet[depth];
-    const int64_t next = address + base;
-    const size_t max_depth = maskSet.size() - 1;
+  // The addresses a part 2 write touches: bits outside `floating` as in
+  // `base`, and every combination of those inside it
+  struct Cube {
+    uint64_t base;
+    uint64_t floating;
 
-    if (depth == max_depth) {
-      {
-        DEBUG_PRINT("mem[" << address << "] = " << val);
-        auto rit = mem.emplace(address, 0);
-        rit.first->second = val;
+    uint64_t size() const {
+      return uint64_t(1) << __builtin_popcountll(floating);
+    }
+  };
+
+  // Cubes meet if they agree on every bit both fix; then the bits fixed
+  // by either are fixed in the intersection
+  std::optional<Cube> Intersect(const Cube& a, const Cube& b) {
+    if ((a.base ^ b.base) & ~a.floating & ~b.floating) { return std::nullopt; }
+    return Cube{ a.base | b.base, a.floating & b.floating };
+  }
+
+  // The addresses of `c` outside every cube in `cover`, each of which
+  // lies inside `c`. Splits `c` on the floating bit most of the cover
+  // fixes, until each piece is either inside a cover cube or clear of
+  // them all.
+  uint64_t CountUncovered(const Cube& c, std::vector<Cube>& cover) {
+    if (cover.empty()) { return c.size(); }
+
+    // Drop cubes inside bigger ones, which splitting would only repeat
+    std::sort(cover.begin(), cover.end(), [](const Cube& a, const Cube& b) {
+      return __builtin_popcountll(a.floating) > __builtin_popcountll(b.floating);
+    });
+    size_t kept = 0;
+    for (const auto& x : cover) {
+      const bool inside = std::any_of(cover.begin(), cover.begin() + kept, [&x](const Cube& y) {
+        return !(x.floating & ~y.floating) && !((x.base ^ y.base) & ~y.floating);
+      });
+      if (!inside) { cover[kept++] = x; }
+    }
+    cover.resize(kept);
+
+    // Small covers directly, by inclusion-exclusion
+    if (cover.size() == 1) {
+      return c.size() - cover[0].size();
+    }
+    if (cover.size() == 2) {
+      const auto both = Intersect(cover[0], cover[1]);
+      return c.size() - cover[0].size() - cover[1].size() + (both ? both->size() : 0);
+    }
+
+    int fixed[AddressBits] = {};
+    for (const auto& x : cover) {
+      if (x.floating == c.floating) { return 0; }
+      for (uint64_t bits = c.floating & ~x.floating; bits; bits &= bits - 1) {
+        fixed[__builtin_ctzll(bits)]++;
       }
-      {
-        DEBUG_PRINT("mem[" << next << "] = " << val);
-        auto rit = mem.emplace(next, 0);
-        rit.first->second = val;
+    }
+    const uint64_t bit = uint64_t(1) << (std::max_element(std::begin(fixed), std::end(fixed)) - std::begin(fixed));
+
+    uint64_t count = 0;
+    std::vector<Cube> half;
+    half.reserve(cover.size());
+    for (const uint64_t value : { uint64_t(0), bit }) {
+      half.clear();
+      for (const auto& x : cover) {
+        if (x.floating & bit) {
+          half.push_back({ x.base | value, x.floating & ~bit });
+        } else if ((x.base & bit) == value) {
+          half.push_back(x);
+        }
+      }
+      count += CountUncovered({ c.base | value, c.floating & ~bit }, half);
+    }
+    return count;
+  }
+
+  // Part 2 without expanding the floating bits. Going back from the last
+  // write, each write only counts at the addresses no later write covers,
+  // found by subtracting its overlaps with the later writes. The cost
+  // follows the number of writes and how much they overlap, not how many
+  // addresses they cover.
+  class SymbolicMemory {
+  private:
+    std::vector<Cube> later;
+    std::vector<Cube> overlaps;
+    unsigned __int128 sum;
+
+  public:
+    SymbolicMemory()
+      : sum(0)
+    { }
+
+    // Writes must arrive latest first
+    void write_before(const Cube& c, uint64_t value) {
+      overlaps.clear();
+      for (const auto& l : later) {
+        if (const auto i = Intersect(c, l)) { overlaps.push_back(*i); }
       }
 
-      return;
+      const uint64_t owned = CountUncovered(c, overlaps);
+      // Completely shadowed, so later writes already cover it
+      if (!owned) { return; }
+
+      sum += static_cast<unsigned __int128>(value) * owned;
+      later.push_back(c);
     }
-    depth++;
 
-    ApplyMemMask(depth, address, maskSet, mem, val);
-    ApplyMemMask(depth, next, maskSet, mem, val);
-  }
+    aoc::BigUint total() const {
+      return ToBigUint(sum);
+    }
+  };
+
+  const auto RunPart2 = [](const Program& program) {
+    SymbolicMemory mem;
+    for (auto it = program.writes.rbegin(); it != program.writes.rend(); it++) {
+      const auto& mask = program.masks[it->mask];
+      mem.write_before({ mask.base_address(it->address), mask.floating }, it->value);
+    }
+    return mem.total();
+  };
 
   const auto LoadInput = [](auto f) {
-    Result r{0, 0};
+    Program program;
     std::string_view line;
     constexpr std::string_view MASK("mask = ");
     constexpr std::string_view MEM("mem[");
 
-    CurrentMask mask;
-    Memory mem;
-    Memory mem2;
-
     while (aoc::getline(f, line)) {
       if (aoc::starts_with(line, MASK)) {
-        mask.clear();
-        const auto mbits = line.substr(MASK.size());
-        assert(mbits.size() == 36);
-
-        mask.reserve(mbits.size());
-        for (const auto &c : mbits) {
-          switch (c) {
-            case 'X':
-              mask.emplace_back(false, false);
-              break;
-            case '1':
-              mask.emplace_back(true, true);
-              break;
-            case '0':
-              mask.emplace_back(true, false);
-              break;
-            default:
-              throw std::runtime_error("Invalid input");
-          }
-        }
-        std::reverse(mask.begin(), mask.end());
+        program.masks.push_back(ParseMask(line.substr(MASK.size())));
+        DEBUG_PRINT("mask = " << program.masks.back());
       } else if (aoc::starts_with(line, MEM)) {
+        if (program.masks.empty()) { throw std::runtime_error("Invalid input"); }
+
         auto n = MEM.size();
         while (n < line.size() && line[n] >= '0' && line[n] <= '9') { n++; }
         assert(line[n] == ']');
 
-        auto address = aoc::stoi(line.substr(MEM.size(), n - MEM.size()));
+        const auto address = aoc::stoi(line.substr(MEM.size(), n - MEM.size()));
         while (n < line.size() && !(line[n] >= '0' && line[n] <= '9')) { n++; }
         assert((line[n] >= '0' && line[n] <= '9'));
         const auto val = aoc::stoi(line.substr(n));
 
-        // Part 1
-        {
-          auto rit = mem.emplace(address, 0);
-          rit.first->second = ApplyMask(mask, val);
-        }
+        program.writes.push_back({ uint64_t(address), uint64_t(val), uint32_t(program.masks.size() - 1) });
+      }
+    }
+
+    return program;
+  };
+
+  // Random masks with exactly `floating` X bits, each used for a few
+  // writes to random addresses
+  Program GenerateProgram(size_t writes, size_t floating, uint32_t seed) {
+    std::mt19937_64 rng(seed);
+    Program program;
+    while (program.writes.size() < writes) {
+      Mask m{ rng() & ((uint64_t(1) << AddressBits) - 1), 0 };
+      while (size_t(__builtin_popcountll(m.floating)) < floating) {
+        m.floating |= uint64_t(1) << (rng() % AddressBits);
+      }
+      m.ones &= ~m.floating;
+      program.masks.push_back(m);
 
-        // Part 2
-        const auto maskSet = GenerateMaskSet(address, mask);
-        ApplyMemMask(0, address, maskSet, mem2, val);
+      for (size_t n = 1 + rng() % 8; n && program.writes.size() < writes; n--) {
+        program.writes.push_back({ rng() & ((uint64_t(1) << AddressBits) - 1), rng() % 1000000,
+          uint32_t(program.masks.size() - 1) });
       }
     }
+    return program;
+  }
 
-    r.first = std::accumulate(mem.begin(), mem.end(), r.first, [](const auto& s, const auto& v) { return s + v.second; });
-    r.second = std::accumulate(mem2.begin (), mem2.end(), r.second, [](const auto& s, const auto& v) { return s + v.second; });
+  // Times part 2 on a generated program symbolically, and by expansion
+  // when that comes to no more than 10^7 addresses, checking they agree
+  void BenchmarkFloating(size_t writes, size_t floating) {
+    const auto program = GenerateProgram(writes, floating, 2020);
 
-    return r;
-  };
+    aoc::BigUint symbolic;
+    {
+      aoc::AutoTimer t("SymbolicMemory");
+      symbolic = RunPart2(program);
+    }
+    std::cout << writes << " writes with " << floating << " floating bits: " << symbolic << std::endl;
+
+    if (double(writes) * double(uint64_t(1) << floating) <= 1e7) {
+      uint64_t expanded;
+      {
+        aoc::AutoTimer t("Expanded");
+        expanded = RunPart2Expanded(program);
+      }
+      aoc::assert_result(symbolic, aoc::BigUint(expanded));
+    }
+  }
+
+  // Times the two expanding backends on the same generated program,
+  // checking they agree with each other and the symbolic memory
+  void BenchmarkLog(size_t writes, size_t floating) {
+    const auto program = GenerateProgram(writes, floating, 2020);
+
+    aoc::BigUint logged;
+    {
+      aoc::AutoTimer t("WriteLog");
+      const WriteLog log(program, std::thread::hardware_concurrency());
+      logged = log.sum();
+      std::cout << log.size() << " addresses written" << std::endl;
+    }
+
+    uint64_t expanded;
+    {
+      aoc::AutoTimer t("Expanded");
+      expanded = RunPart2Expanded(program);
+    }
+    std::cout << writes << " writes with " << floating << " floating bits: " << logged << std::endl;
+    aoc::assert_result(logged, aoc::BigUint(expanded));
+    aoc::assert_result(logged, RunPart2(program));
+  }
 }
 
 int main(int argc, char** argv) {
+  if (argc > 1 && BENCH_FLOATING == argv[1]) {
+    const size_t writes = argc > 2 ? aoc::stoi(argv[2]) : 500;
+    const size_t floating = argc > 3 ? aoc::stoi(argv[3]) : 24;
+    BenchmarkFloating(writes, floating);
+    return 0;
+  }
+  if (argc > 1 && BENCH_LOG == argv[1]) {
+    const size_t writes = argc > 2 ? aoc::stoi(argv[2]) : 500;
+    const size_t floating = argc > 3 ? aoc::stoi(argv[3]) : 14;
+    BenchmarkLog(writes, floating);
+    return 0;
+  }
+
   aoc::AutoTimer t;
   const bool inTest = argc < 2;
 
-  Result r;
+  Program program;
   if (inTest) {
-    r = LoadInput(SampleInput);
+    program = LoadInput(SampleInput);
   } else {
     std::unique_ptr<MappedFileSource>m(new MappedFileSource(argc, argv));
     std::string_view f(m->data(), m->size());
-    r = LoadInput(f);
+    program = LoadInput(f);
   }
 
-  int64_t part1 = 0;
-  int64_t part2 = 0;
-
-  std::tie(part1, part2) = r;
+  int64_t part1 = RunPart1(program);
+  aoc::BigUint part2 = RunPart2(program);
 
   aoc::print_results(part1, part2);
 
   if (inTest) {
     aoc::assert_result(part1, SR_Part1);
     aoc::assert_result(part2, SR_Part2);
+    aoc::assert_result(RunPart2Expanded(program), SR_Part2);
+    aoc::assert_result(RunPart2Log(program), aoc::BigUint(SR_Part2));
+
+    // 32 addresses of 2^60 each, past 64 bits
+    const Program wide{ { { 0, 0x1f } }, { { 0, uint64_t(1) << 60, 0 } } };
+    const auto expected = ToBigUint(static_cast<unsigned __int128>(1) << 65);
+    aoc::assert_result(RunPart2(wide), expected);
+    aoc::assert_result(RunPart2Log(wide), expected);
   }
 
   return 0;
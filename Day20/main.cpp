@@ -388,7 +388,7 @@ Tile 3079:
         for (size_t x = 0; x < _width; x++) {
           const size_t from = y * _width + x;
           const size_t to = (_height - y - 1) * _width + x;
-          std::swap(_image[from], _image[to]);
+          _image.swap(_image[from], _image[to]);
         }
       }
     }
@@ -398,7 +398,7 @@ Tile 3079:
         for (size_t x = y + 1; x < _width; x++) {
           const size_t from = y * _width + x;
           const size_t to = x * _width + y;
-          std::swap(_image[from], _image[to]);
+          _image.swap(_image[from], _image[to]);
         }
         std::reverse(_image.begin() + (y * _width), _image.begin() + ((y + 1) * _width));
       }
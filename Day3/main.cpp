@@ -2,7 +2,13 @@
 
 #include <vector>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
 namespace {
+  STRING_CONSTANT(SWEEP, "sweep");
+
   using Row = std::vector<bool>;
   using Grid = std::vector<Row>;
 
@@ -60,6 +66,84 @@ namespace {
 
     return input;
   };
+
+  // One byte per cell, with each row padded so a 32-bit gather at the last
+  // column never reads past the row.
+  struct PackedGrid {
+    std::vector<uint8_t> cells;
+    size_t width;
+    size_t height;
+    size_t stride;
+  };
+
+  const auto PackGrid = [](const Grid& g) {
+    PackedGrid p{ {}, g.empty() ? 0 : g[0].size(), g.size(), 0 };
+    p.stride = (p.width + sizeof(int32_t) + 31) & ~size_t(31);
+    p.cells.resize(p.stride * p.height, 0);
+    for (size_t y = 0; y < p.height; y++) {
+      for (size_t x = 0; x < p.width; x++) {
+        p.cells[y * p.stride + x] = g[y][x];
+      }
+    }
+    return p;
+  };
+
+  // Tree counts indexed as [dy - 1][dx - 1]
+  using SlopeTable = std::vector<std::vector<int64_t>>;
+
+  // Counts trees for every slope with dx in [1, width) and dy in [1, max_dy].
+  // All slopes sharing a dy visit the same rows, so each visited row is
+  // loaded once and every dx column is gathered from it side by side.
+  const auto SweepSlopes = [](const PackedGrid& p, size_t max_dy) {
+    const size_t nx = p.width > 1 ? p.width - 1 : 0;
+    SlopeTable table(max_dy, std::vector<int64_t>(nx, 0));
+    if (!nx) { return table; }
+
+    // Lanes past nx step by 0 so they keep gathering column 0 harmlessly
+    const size_t lanes = (nx + 7) & ~size_t(7);
+    std::vector<int32_t> pos(lanes);
+    std::vector<int32_t> step(lanes, 0);
+    std::vector<int32_t> count(lanes);
+    for (size_t i = 0; i < nx; i++) {
+      step[i] = i + 1;
+    }
+    const int32_t width = p.width;
+
+    for (size_t dy = 1; dy <= max_dy; dy++) {
+      std::fill(pos.begin(), pos.end(), 0);
+      std::fill(count.begin(), count.end(), 0);
+
+      for (size_t y = 0; y < p.height; y += dy) {
+        const uint8_t* row = p.cells.data() + y * p.stride;
+#if defined(__AVX2__)
+        const __m256i w = _mm256_set1_epi32(width);
+        const __m256i wm1 = _mm256_set1_epi32(width - 1);
+        const __m256i one = _mm256_set1_epi32(1);
+        for (size_t i = 0; i < lanes; i += 8) {
+          __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&pos[i]));
+          __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&count[i]));
+          const __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&step[i]));
+          const __m256i t = _mm256_i32gather_epi32(reinterpret_cast<const int*>(row), x, 1);
+          c = _mm256_add_epi32(c, _mm256_and_si256(t, one));
+          x = _mm256_add_epi32(x, s);
+          x = _mm256_sub_epi32(x, _mm256_and_si256(_mm256_cmpgt_epi32(x, wm1), w));
+          _mm256_storeu_si256(reinterpret_cast<__m256i*>(&pos[i]), x);
+          _mm256_storeu_si256(reinterpret_cast<__m256i*>(&count[i]), c);
+        }
+#else
+        for (size_t i = 0; i < lanes; i++) {
+          count[i] += row[pos[i]];
+          pos[i] += step[i];
+          pos[i] -= (pos[i] >= width) ? width : 0;
+        }
+#endif
+      }
+
+      std::copy(count.begin(), count.begin() + nx, table[dy - 1].begin());
+    }
+
+    return table;
+  };
 }
 
 int main(int argc, char** argv) {
@@ -107,6 +191,29 @@ int main(int argc, char** argv) {
     aoc::assert_result(part2, SR_Part2);
   }
 
+  const bool sweep = argc > 2 && SWEEP == argv[2];
+  if (inTest || sweep) {
+    const size_t max_dy = argc > 3 ? aoc::stoi(argv[3]) : 2;
+    const auto table = SweepSlopes(PackGrid(input), max_dy);
+
+    if (inTest) {
+      int64_t product = 1;
+      for (const auto& slope : slopes) {
+        product *= table[slope.second - 1][slope.first - 1];
+      }
+      aoc::assert_result(table[0][2], SR_Part1);
+      aoc::assert_result(product, SR_Part2);
+    } else {
+      for (size_t dy = 1; dy <= table.size(); dy++) {
+        std::cout << "dy " << dy << ":";
+        for (const auto& c : table[dy - 1]) {
+          std::cout << " " << c;
+        }
+        std::cout << std::endl;
+      }
+    }
+  }
+
   return 0;
 }
 
@@ -1,8 +1,13 @@
 #include "aoc/helpers.h"
 
-#include <set>
+#include <array>
+#include <cstring>
 #include <vector>
 
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
 namespace {
   using Input = std::pair<int, int>;
   using MappedFileSource = aoc::MappedFileSource<char>;
@@ -23,6 +28,54 @@ iyr:2011 ecl:brn hgt:59in)");
   constexpr int SR_Part1 = 2;
   constexpr int SR_Part2 = 2;
 
+  // The part 2 examples, and a few more edge cases, to run the columnar
+  // path against the row by row one over enough records to use the vector
+  // kernels. The last record's second pid is too short, so it's invalid,
+  // and the two before it each have a field with an empty value, which
+  // counts as missing.
+  const std::string ValidationInput(R"(eyr:1972 cid:100
+hcl:#18171d ecl:amb hgt:170 pid:186cm iyr:2018 byr:1926
+
+iyr:2019
+hcl:#602927 eyr:1967 hgt:170cm
+ecl:grn pid:012533040 byr:1946
+
+hcl:dab227 iyr:2012
+ecl:brn hgt:182cm pid:021572410 eyr:2020 byr:1992 cid:277
+
+hgt:59cm ecl:zzz
+eyr:2038 hcl:74454a iyr:2023
+pid:3556412378 byr:2007
+
+pid:087499704 hgt:74in ecl:grn iyr:2012 eyr:2030 byr:1980
+hcl:#623a2f
+
+eyr:2029 ecl:blu cid:129 byr:1989
+iyr:2014 pid:896056539 hcl:#a97842 hgt:165cm
+
+hcl:#888785
+hgt:164cm byr:2001 iyr:2015 cid:88
+pid:545766238 ecl:hzl
+eyr:2022
+
+iyr:2010 hgt:158cm hcl:#b6652a ecl:blu byr:1944 eyr:2021 pid:093154719
+
+iyr:2010 hgt:193cm hcl:#b6652g ecl:blu byr:1944 eyr:2021 pid:093154719
+
+iyr:2010 hgt:76in hcl:#0000000 ecl:oth byr:2002 eyr:2021 pid:093154719
+
+iyr:2020 hgt:150cm hcl:#abcdef ecl:amb byr:1920 eyr:2030 pid:000000000
+
+byr: iyr:2010 eyr:2020 hgt:150cm hcl:#abcdef ecl:amb pid:000000000
+
+iyr:2010 hgt:158cm hcl:#b6652a ecl:blu byr:1944 eyr:2021 pid:093154719 hcl:
+
+iyr:2010 hgt:158cm hcl:#b6652a ecl:blu byr:1944 eyr:2021 pid:093154719 pid:12345)");
+  constexpr int VR_Part1 = 12;
+  constexpr int VR_Part2 = 5;
+
+  STRING_CONSTANT(COLUMNAR, "columnar");
+
   constexpr std::string_view byr("byr");
   constexpr std::string_view iyr("iyr");
   constexpr std::string_view eyr("eyr");
@@ -61,53 +114,120 @@ iyr:2011 ecl:brn hgt:59in)");
       !p.pid.empty();
   }
 
-  const std::set<std::string, std::less<>> ValidEyeColors{
-    { "amb" }, {"blu"}, {"brn"}, {"gry"}, {"grn"}, {"hzl"}, { "oth" }
+  // Packs a 3 byte field key (or eye color) into an integer so it can be
+  // dispatched with a switch or compared against packed constants.
+  constexpr uint32_t PackKey(const std::string_view s) {
+    return uint32_t(uint8_t(s[0])) |
+      (uint32_t(uint8_t(s[1])) << 8) |
+      (uint32_t(uint8_t(s[2])) << 16);
+  }
+
+  constexpr std::array<uint32_t, 7> ValidEyeColors{
+    PackKey("amb"), PackKey("blu"), PackKey("brn"), PackKey("gry"),
+    PackKey("grn"), PackKey("hzl"), PackKey("oth"),
   };
 
-  bool IsDataValid(const Passport& p) {
-    if (!IsValid(p)) { return false; }
+  // A field value copied into a zero padded buffer, along with bitmasks of
+  // which bytes are decimal digits and which are lower case hex digits.
+  struct Field {
+    std::array<char, 16> buf;
+    size_t size;
+    uint32_t digit;
+    uint32_t hex;
+  };
 
-    int v = aoc::stoi(p.byr);
-    if (v < 1920 || v > 2002) { DEBUG_PRINT("invalid byr"); return false; }
+  const auto ClassifyField = [](const std::string_view s) {
+    Field f{ {}, s.size(), 0, 0 };
+    std::memcpy(f.buf.data(), s.data(), std::min(s.size(), f.buf.size()));
+#if defined(__SSE2__)
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(f.buf.data()));
+    const __m128i digit = _mm_and_si128(
+      _mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+      _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+    const __m128i alpha = _mm_and_si128(
+      _mm_cmpgt_epi8(v, _mm_set1_epi8('a' - 1)),
+      _mm_cmplt_epi8(v, _mm_set1_epi8('f' + 1)));
+    f.digit = _mm_movemask_epi8(digit);
+    f.hex = _mm_movemask_epi8(_mm_or_si128(digit, alpha));
+#else
+    for (size_t i = 0; i < f.buf.size(); i++) {
+      const char c = f.buf[i];
+      const uint32_t d = (c >= '0') & (c <= '9');
+      const uint32_t a = (c >= 'a') & (c <= 'f');
+      f.digit |= d << i;
+      f.hex |= (d | a) << i;
+    }
+#endif
+    return f;
+  };
 
-    v = aoc::stoi(p.iyr);
-    if (v < 2010 || v > 2020) { DEBUG_PRINT("invalid iyr"); return false; }
+  constexpr uint32_t LowBits(size_t n) {
+    return (1u << n) - 1;
+  }
 
-    v = aoc::stoi(p.eyr);
-    if (v < 2020 || v > 2030) { DEBUG_PRINT("invalid eyr6"); return false; }
+  // Only meaningful once the digit mask has been checked
+  const auto ParseDigits = [](const Field& f, size_t from, size_t n) {
+    int v = 0;
+    for (size_t i = from; i < from + n; i++) {
+      v = v * 10 + (f.buf[i] - '0');
+    }
+    return v;
+  };
 
-    if (aoc::ends_with(p.hgt, "in")) {
-      v = aoc::stoi(p.hgt.substr(0, p.hgt.size() - 2));
-      if (v < 59 || v > 76) { DEBUG_PRINT("invalid hgt: " << v); return false; }
-    } else if (aoc::ends_with(p.hgt, "cm")) {
-      v = aoc::stoi(p.hgt.substr(0, p.hgt.size() - 2));
-      if (v < 150 || v > 193) { DEBUG_PRINT("invalid hgt: " << v); return false; }
-    } else { DEBUG_PRINT("invalid hgt"); return false; }
+  const auto IsYearIn = [](const std::string_view s, int lo, int hi) {
+    const auto f = ClassifyField(s);
+    const int v = ParseDigits(f, 0, 4);
+    return (f.size == 4) & ((f.digit & LowBits(4)) == LowBits(4)) & (v >= lo) & (v <= hi);
+  };
 
-    if (p.hcl.size() != 7 || p.hcl[0] != '#') { DEBUG_PRINT("invalid hcl"); return false; }
-    for (const auto& c : p.hcl.substr(1)) {
-      if ((c >= 'a' && c <= 'f') || (c >= '0' && c <= '9')) {
-        continue;
-      }
-      DEBUG_PRINT("invalid hcl"); 
-      return false;
-    }
+  const auto IsHeightValid = [](const std::string_view s) {
+    const auto f = ClassifyField(s);
+    const size_t n = std::min<size_t>(f.size, 5) - 2 * (f.size >= 2);
+    const uint32_t unit = uint32_t(uint8_t(f.buf[n])) | (uint32_t(uint8_t(f.buf[n + 1])) << 8);
+    const bool digits = (f.digit & LowBits(n)) == LowBits(n);
+    const int v = ParseDigits(f, 0, n);
+    constexpr uint32_t CM = 'c' | ('m' << 8);
+    constexpr uint32_t IN = 'i' | ('n' << 8);
+    const bool cm = (f.size == 5) & (unit == CM) & (v >= 150) & (v <= 193);
+    const bool in = (f.size == 4) & (unit == IN) & (v >= 59) & (v <= 76);
+    return digits & (cm | in);
+  };
 
-    if (ValidEyeColors.find(p.ecl) == ValidEyeColors.end()) {
-      DEBUG_PRINT("invalid ecl"); return false;
-    }
+  const auto IsHairColorValid = [](const std::string_view s) {
+    const auto f = ClassifyField(s);
+    return (f.size == 7) & (f.buf[0] == '#') & (((f.hex >> 1) & LowBits(6)) == LowBits(6));
+  };
 
-    if (p.pid.size() != 9) { DEBUG_PRINT("invalid pid"); return false; }
-    for (const auto& c : p.pid.substr(1)) {
-      if (c >= '0' && c <= '9') {
-        continue;
-      }
-      DEBUG_PRINT("invalid pid"); 
-      return false;
+  const auto IsEyeColorValid = [](const std::string_view s) {
+    if (s.size() != 3) { return false; }
+    const uint32_t v = PackKey(s);
+    bool found = false;
+    for (const auto& c : ValidEyeColors) {
+      found |= (v == c);
     }
+    return found;
+  };
+
+  const auto IsPassportIdValid = [](const std::string_view s) {
+    const auto f = ClassifyField(s);
+    return (f.size == 9) & ((f.digit & LowBits(9)) == LowBits(9));
+  };
 
-    return true;
+  bool IsDataValid(const Passport& p) {
+    if (!IsValid(p)) { return false; }
+
+    const bool byr = IsYearIn(p.byr, 1920, 2002);
+    const bool iyr = IsYearIn(p.iyr, 2010, 2020);
+    const bool eyr = IsYearIn(p.eyr, 2020, 2030);
+    const bool hgt = IsHeightValid(p.hgt);
+    const bool hcl = IsHairColorValid(p.hcl);
+    const bool ecl = IsEyeColorValid(p.ecl);
+    const bool pid = IsPassportIdValid(p.pid);
+
+    DEBUG_PRINT("byr: " << byr << " iyr: " << iyr << " eyr: " << eyr << " hgt: " << hgt <<
+      " hcl: " << hcl << " ecl: " << ecl << " pid: " << pid);
+
+    return byr & iyr & eyr & hgt & hcl & ecl & pid;
   }
 
   const auto LoadInput = [](std::string_view f) {
@@ -133,15 +253,20 @@ iyr:2011 ecl:brn hgt:59in)");
       std::string_view field = line.substr(0, pos);
       std::string_view value = line.substr(pos + 1);
 
-      if (field == byr) { p.byr = value; }
-      else if (field == iyr) { p.iyr = value; }
-      else if (field == eyr) { p.eyr = value; }
-      else if (field == hgt) { p.hgt = value; }
-      else if (field == hcl) { p.hcl = value; }
-      else if (field == ecl) { p.ecl = value; }
-      else if (field == pid) { p.pid = value; }
-      else if (field == cid) { p.cid = value; }
-      else { assert(false); }
+      assert(field.size() == 3);
+      if (field.size() != 3) { continue; }
+
+      switch (PackKey(field)) {
+        case PackKey(byr): p.byr = value; break;
+        case PackKey(iyr): p.iyr = value; break;
+        case PackKey(eyr): p.eyr = value; break;
+        case PackKey(hgt): p.hgt = value; break;
+        case PackKey(hcl): p.hcl = value; break;
+        case PackKey(ecl): p.ecl = value; break;
+        case PackKey(pid): p.pid = value; break;
+        case PackKey(cid): p.cid = value; break;
+        default: assert(false); break;
+      }
     }
 
     {
@@ -155,6 +280,334 @@ iyr:2011 ecl:brn hgt:59in)");
     
     return input;
   };
+
+  // Columnar validation: a block of passports is split into one fixed width
+  // column per field, each column is validated on its own into a bitmask
+  // (bit i is record i), and the per field bitmasks are ANDed together.
+  constexpr size_t BlockSize = 4096;
+  constexpr size_t BlockWords = BlockSize / 64;
+
+  using Bitmask = std::array<uint64_t, BlockWords>;
+
+  // Field values are stored as their raw bytes, zero padded. Values that do
+  // not fit the column width are stored as 0, which never validates.
+  struct PassportColumns {
+    std::array<uint32_t, BlockSize> byr;
+    std::array<uint32_t, BlockSize> iyr;
+    std::array<uint32_t, BlockSize> eyr;
+    std::array<uint64_t, BlockSize> hgt;
+    std::array<uint64_t, BlockSize> hcl;
+    std::array<uint32_t, BlockSize> ecl;
+    std::array<uint64_t, BlockSize> pid_lo;
+    std::array<uint32_t, BlockSize> pid_hi;
+    std::array<uint8_t, BlockSize> present;
+    size_t size;
+  };
+
+  constexpr uint8_t AllPresent = 0x7f;
+
+  template<typename T>
+  T PackValue(const std::string_view s) {
+    T v = 0;
+    if (s.size() <= sizeof(T)) {
+      std::memcpy(&v, s.data(), s.size());
+    }
+    return v;
+  }
+
+  constexpr uint64_t Bytes(uint64_t b, size_t n) {
+    return n ? (b | (Bytes(b, n - 1) << 8)) : 0;
+  }
+
+  // True when every byte selected by `mask` is an ASCII decimal digit
+  constexpr bool AllDigits(uint64_t x, uint64_t mask) {
+    const uint64_t hi = Bytes(0xf0, 8) & mask;
+    const uint64_t zero = Bytes(0x30, 8) & mask;
+    x &= mask;
+    return ((x & hi) == zero) & (((x + (Bytes(0x06, 8) & mask)) & hi) == zero);
+  }
+
+  // 0x80 in each byte from lo to hi, for bytes below 0x80
+  constexpr uint64_t InRange(uint64_t x, uint8_t lo, uint8_t hi) {
+    return ((x | Bytes(0x80, 8)) - Bytes(lo, 8)) & (Bytes(0x80 | hi, 8) - x) & Bytes(0x80, 8);
+  }
+
+  const auto SetBit = [](Bitmask& m, size_t i, bool v) {
+    m[i / 64] |= uint64_t(v) << (i % 64);
+  };
+
+#if defined(__AVX2__)
+  // The 64 bit lane versions of the SWAR helpers above, four records at a
+  // time, giving all ones in each lane where the scalar version is true
+  __m256i Splat(uint64_t v) {
+    return _mm256_set1_epi64x(int64_t(v));
+  }
+
+  __m256i AllDigits4(__m256i x, uint64_t mask) {
+    const __m256i hi = Splat(Bytes(0xf0, 8) & mask);
+    const __m256i zero = Splat(Bytes(0x30, 8) & mask);
+    x = _mm256_and_si256(x, Splat(mask));
+    return _mm256_and_si256(
+      _mm256_cmpeq_epi64(_mm256_and_si256(x, hi), zero),
+      _mm256_cmpeq_epi64(_mm256_and_si256(_mm256_add_epi64(x, Splat(Bytes(0x06, 8) & mask)), hi), zero));
+  }
+
+  __m256i InRange4(__m256i x, uint8_t lo, uint8_t hi) {
+    return _mm256_and_si256(_mm256_and_si256(
+      _mm256_sub_epi64(_mm256_or_si256(x, Splat(Bytes(0x80, 8))), Splat(Bytes(lo, 8))),
+      _mm256_sub_epi64(Splat(Bytes(0x80 | hi, 8)), x)), Splat(Bytes(0x80, 8)));
+  }
+
+  // Lanes whose bits under `mask` are exactly `v`
+  __m256i Matches4(__m256i x, uint64_t mask, uint64_t v) {
+    return _mm256_cmpeq_epi64(_mm256_and_si256(x, Splat(mask)), Splat(v));
+  }
+
+  // The decimal number in bytes `from` to `from + n` of each lane, once
+  // '0' has been subtracted from them
+  __m256i Decimal4(__m256i d, size_t from, size_t n) {
+    __m256i v = _mm256_setzero_si256();
+    for (size_t b = from; b < from + n; b++) {
+      v = _mm256_add_epi64(_mm256_mul_epu32(v, Splat(10)),
+        _mm256_and_si256(_mm256_srli_epi64(d, int(b * 8)), Splat(0xff)));
+    }
+    return v;
+  }
+
+  __m256i Between4(__m256i v, int64_t lo, int64_t hi) {
+    return _mm256_and_si256(_mm256_cmpgt_epi64(v, Splat(lo - 1)), _mm256_cmpgt_epi64(Splat(hi + 1), v));
+  }
+
+  void SetBits4(Bitmask& m, size_t i, __m256i ok) {
+    const uint64_t bits = _mm256_movemask_pd(_mm256_castsi256_pd(ok));
+    m[i / 64] |= bits << (i % 64);
+  }
+#endif
+
+  const auto ValidateYears = [](const std::array<uint32_t, BlockSize>& col, size_t n, int lo, int hi) {
+    Bitmask m{};
+    size_t i = 0;
+#if defined(__AVX2__)
+    const __m256i hi_nibble = _mm256_set1_epi32(Bytes(0xf0, 4));
+    const __m256i zero = _mm256_set1_epi32(Bytes(0x30, 4));
+    const __m256i six = _mm256_set1_epi32(Bytes(0x06, 4));
+    const __m256i byte = _mm256_set1_epi32(0xff);
+    const __m256i vlo = _mm256_set1_epi32(lo - 1);
+    const __m256i vhi = _mm256_set1_epi32(hi + 1);
+    for (; i + 8 <= n; i += 8) {
+      const __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&col[i]));
+      const __m256i digits = _mm256_and_si256(
+        _mm256_cmpeq_epi32(_mm256_and_si256(x, hi_nibble), zero),
+        _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_add_epi32(x, six), hi_nibble), zero));
+      const __m256i d = _mm256_sub_epi32(x, zero);
+      __m256i v = _mm256_mullo_epi32(_mm256_and_si256(d, byte), _mm256_set1_epi32(1000));
+      v = _mm256_add_epi32(v, _mm256_mullo_epi32(_mm256_and_si256(_mm256_srli_epi32(d, 8), byte), _mm256_set1_epi32(100)));
+      v = _mm256_add_epi32(v, _mm256_mullo_epi32(_mm256_and_si256(_mm256_srli_epi32(d, 16), byte), _mm256_set1_epi32(10)));
+      v = _mm256_add_epi32(v, _mm256_srli_epi32(d, 24));
+      const __m256i ok = _mm256_and_si256(digits,
+        _mm256_and_si256(_mm256_cmpgt_epi32(v, vlo), _mm256_cmpgt_epi32(vhi, v)));
+      const uint64_t bits = _mm256_movemask_ps(_mm256_castsi256_ps(ok));
+      m[i / 64] |= bits << (i % 64);
+    }
+#endif
+    for (; i < n; i++) {
+      const uint32_t x = col[i];
+      const uint32_t d = x - Bytes(0x30, 4);
+      const int v = (d & 0xff) * 1000 + ((d >> 8) & 0xff) * 100 + ((d >> 16) & 0xff) * 10 + (d >> 24);
+      SetBit(m, i, AllDigits(x, Bytes(0xff, 4)) & (v >= lo) & (v <= hi));
+    }
+    return m;
+  };
+
+  const auto ValidateEyeColors = [](const std::array<uint32_t, BlockSize>& col, size_t n) {
+    Bitmask m{};
+    size_t i = 0;
+#if defined(__AVX2__)
+    for (; i + 8 <= n; i += 8) {
+      const __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&col[i]));
+      __m256i ok = _mm256_setzero_si256();
+      for (const auto& c : ValidEyeColors) {
+        ok = _mm256_or_si256(ok, _mm256_cmpeq_epi32(x, _mm256_set1_epi32(c)));
+      }
+      const uint64_t bits = _mm256_movemask_ps(_mm256_castsi256_ps(ok));
+      m[i / 64] |= bits << (i % 64);
+    }
+#endif
+    for (; i < n; i++) {
+      bool found = false;
+      for (const auto& c : ValidEyeColors) {
+        found |= (col[i] == c);
+      }
+      SetBit(m, i, found);
+    }
+    return m;
+  };
+
+  const auto ValidateHeights = [](const std::array<uint64_t, BlockSize>& col, size_t n) {
+    constexpr uint64_t CM = uint64_t('c' | ('m' << 8)) << 24;
+    constexpr uint64_t IN = uint64_t('i' | ('n' << 8)) << 16;
+    Bitmask m{};
+    size_t i = 0;
+#if defined(__AVX2__)
+    for (; i + 4 <= n; i += 4) {
+      const __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&col[i]));
+      const __m256i d = _mm256_sub_epi64(x, Splat(Bytes(0x30, 3)));
+      const __m256i is_cm = _mm256_and_si256(_mm256_and_si256(
+        Matches4(x, ~Bytes(0xff, 3), CM), AllDigits4(x, Bytes(0xff, 3))), Between4(Decimal4(d, 0, 3), 150, 193));
+      const __m256i is_in = _mm256_and_si256(_mm256_and_si256(
+        Matches4(x, ~Bytes(0xff, 2), IN), AllDigits4(x, Bytes(0xff, 2))), Between4(Decimal4(d, 0, 2), 59, 76));
+      SetBits4(m, i, _mm256_or_si256(is_cm, is_in));
+    }
+#endif
+    for (; i < n; i++) {
+      const uint64_t x = col[i];
+      const uint64_t d = x - Bytes(0x30, 3);
+      const int cm = (d & 0xff) * 100 + ((d >> 8) & 0xff) * 10 + ((d >> 16) & 0xff);
+      const int in = (d & 0xff) * 10 + ((d >> 8) & 0xff);
+      const bool is_cm = ((x & ~Bytes(0xff, 3)) == CM) & AllDigits(x, Bytes(0xff, 3)) & (cm >= 150) & (cm <= 193);
+      const bool is_in = ((x & ~Bytes(0xff, 2)) == IN) & AllDigits(x, Bytes(0xff, 2)) & (in >= 59) & (in <= 76);
+      SetBit(m, i, is_cm | is_in);
+    }
+    return m;
+  };
+
+  // '#', six lower case hex digits and a zero byte
+  const auto ValidateHairColors = [](const std::array<uint64_t, BlockSize>& col, size_t n) {
+    constexpr uint64_t Digits = Bytes(0x80, 7) & ~uint64_t(0xff);
+    constexpr uint64_t Ends = 0xff000000000000ff;
+    Bitmask m{};
+    size_t i = 0;
+#if defined(__AVX2__)
+    for (; i + 4 <= n; i += 4) {
+      const __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&col[i]));
+      const __m256i hex = _mm256_or_si256(InRange4(x, '0', '9'), InRange4(x, 'a', 'f'));
+      const __m256i ascii = Matches4(x, Bytes(0x80, 8), 0);
+      SetBits4(m, i, _mm256_and_si256(_mm256_and_si256(ascii, Matches4(x, Ends, '#')), Matches4(hex, Digits, Digits)));
+    }
+#endif
+    for (; i < n; i++) {
+      const uint64_t x = col[i];
+      const uint64_t hex = InRange(x, '0', '9') | InRange(x, 'a', 'f');
+      const bool ascii = !(x & Bytes(0x80, 8));
+      SetBit(m, i, ascii & ((x & Ends) == '#') & ((hex & Digits) == Digits));
+    }
+    return m;
+  };
+
+  const auto ValidatePassportIds = [](const PassportColumns& c, size_t n) {
+    Bitmask m{};
+    size_t i = 0;
+#if defined(__AVX2__)
+    for (; i + 4 <= n; i += 4) {
+      const __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&c.pid_lo[i]));
+      const __m256i hi = _mm256_cvtepu32_epi64(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&c.pid_hi[i])));
+      SetBits4(m, i, _mm256_and_si256(_mm256_and_si256(AllDigits4(lo, Bytes(0xff, 8)), AllDigits4(hi, 0xff)),
+        Matches4(hi, ~uint64_t(0xff), 0)));
+    }
+#endif
+    for (; i < n; i++) {
+      SetBit(m, i, AllDigits(c.pid_lo[i], Bytes(0xff, 8)) & AllDigits(c.pid_hi[i], 0xff) & ((c.pid_hi[i] >> 8) == 0));
+    }
+    return m;
+  };
+
+  const auto ValidatePresence = [](const std::array<uint8_t, BlockSize>& col, size_t n) {
+    Bitmask m{};
+    size_t i = 0;
+#if defined(__AVX2__)
+    const __m256i all = _mm256_set1_epi8(AllPresent);
+    for (; i + 32 <= n; i += 32) {
+      const __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&col[i]));
+      const uint64_t bits = uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_and_si256(x, all), all)));
+      m[i / 64] |= bits << (i % 64);
+    }
+#endif
+    for (; i < n; i++) {
+      SetBit(m, i, (col[i] & AllPresent) == AllPresent);
+    }
+    return m;
+  };
+
+  const auto ValidateBlock = [](const PassportColumns& c, Input& input) {
+    const size_t n = c.size;
+    const auto present = ValidatePresence(c.present, n);
+    const auto byr = ValidateYears(c.byr, n, 1920, 2002);
+    const auto iyr = ValidateYears(c.iyr, n, 2010, 2020);
+    const auto eyr = ValidateYears(c.eyr, n, 2020, 2030);
+    const auto hgt = ValidateHeights(c.hgt, n);
+    const auto hcl = ValidateHairColors(c.hcl, n);
+    const auto ecl = ValidateEyeColors(c.ecl, n);
+    const auto pid = ValidatePassportIds(c, n);
+
+    for (size_t w = 0; w < BlockWords; w++) {
+      const uint64_t valid = present[w] & byr[w] & iyr[w] & eyr[w] & hgt[w] & hcl[w] & ecl[w] & pid[w];
+      input.first += __builtin_popcountll(present[w]);
+      input.second += __builtin_popcountll(valid);
+    }
+  };
+
+  const auto LoadColumnar = [](std::string_view f) {
+    Input input{ 0, 0 };
+
+    std::unique_ptr<PassportColumns> c(new PassportColumns());
+    c->size = 0;
+
+    // The record being filled is always c->size; it is only counted once it
+    // has at least one field.
+    bool open = false;
+    const auto end_record = [&]() {
+      if (!open) { return; }
+      open = false;
+      if (++c->size == BlockSize) {
+        ValidateBlock(*c, input);
+        std::memset(c.get(), 0, sizeof(PassportColumns));
+      }
+    };
+
+    std::string_view line;
+    while (aoc::getline(f, line, "\r\n ", true)) {
+      if (line.empty()) {
+        end_record();
+        continue;
+      }
+      const auto pos = line.find(':');
+      if (pos != 3) { continue; }
+
+      const std::string_view value = line.substr(pos + 1);
+      const size_t i = c->size;
+      open = true;
+
+      // An empty value counts as missing, and the last occurrence of a
+      // field wins, as in LoadInput
+      const auto present = [&](size_t bit) {
+        c->present[i] = (c->present[i] & ~(1 << bit)) | (!value.empty() << bit);
+      };
+
+      switch (PackKey(line)) {
+        case PackKey(byr): c->byr[i] = PackValue<uint32_t>(value); present(0); break;
+        case PackKey(iyr): c->iyr[i] = PackValue<uint32_t>(value); present(1); break;
+        case PackKey(eyr): c->eyr[i] = PackValue<uint32_t>(value); present(2); break;
+        case PackKey(hgt): c->hgt[i] = PackValue<uint64_t>(value); present(3); break;
+        case PackKey(hcl): c->hcl[i] = PackValue<uint64_t>(value); present(4); break;
+        case PackKey(ecl):
+          c->ecl[i] = value.size() == 3 ? PackKey(value) : 0;
+          present(5);
+          break;
+        case PackKey(pid):
+          // A later pid replaces an earlier one even when it's invalid
+          c->pid_lo[i] = value.size() == 9 ? PackValue<uint64_t>(value.substr(0, 8)) : 0;
+          c->pid_hi[i] = value.size() == 9 ? PackValue<uint32_t>(value.substr(8)) : 0;
+          present(6);
+          break;
+        case PackKey(cid): break;
+        default: assert(false); break;
+      }
+    }
+    end_record();
+    ValidateBlock(*c, input);
+
+    return input;
+  };
 }
 
 int main(int argc, char** argv) {
@@ -167,7 +620,8 @@ int main(int argc, char** argv) {
   } else {
     std::unique_ptr<MappedFileSource>m(new MappedFileSource(argc, argv));
     std::string_view f(m->data(), m->size());
-    input = LoadInput(f);
+    const bool columnar = argc > 2 && COLUMNAR == argv[2];
+    input = columnar ? LoadColumnar(f) : LoadInput(f);
   }
 
   int part1 = 0;
@@ -180,6 +634,24 @@ int main(int argc, char** argv) {
   if (inTest) {
     aoc::assert_result(part1, SR_Part1);
     aoc::assert_result(part2, SR_Part2);
+
+    const auto columnar = LoadColumnar(SampleInput);
+    aoc::assert_result(columnar.first, SR_Part1);
+    aoc::assert_result(columnar.second, SR_Part2);
+
+    const auto rows = LoadInput(ValidationInput);
+    aoc::assert_result(rows.first, VR_Part1);
+    aoc::assert_result(rows.second, VR_Part2);
+
+    // Enough copies for every kernel's vector loop, and a scalar tail
+    std::string many;
+    for (size_t i = 0; i < 5; i++) {
+      many += ValidationInput + "\n\n";
+    }
+    const auto many_rows = LoadInput(many);
+    const auto many_columns = LoadColumnar(many);
+    aoc::assert_result(many_columns.first, many_rows.first);
+    aoc::assert_result(many_columns.second, many_rows.second);
   }
 
   return 0;
@@ -1,13 +1,17 @@
 #include "aoc/helpers.h"
 
+#include <array>
+#include <cstring>
 #include <vector>
 
+#if defined(__SSSE3__)
+#include <immintrin.h>
+#endif
+
 namespace {
   using Result = std::pair<int, int>;
   using MappedFileSource = aoc::MappedFileSource<char>;
 
-  using SeatMap = std::vector<bool>;
-
   constexpr std::string_view SampleInput(R"(FBFBBFFRLR
 BFFFBBFRRR
 FFFBBBFRRR
@@ -15,80 +19,236 @@ BBFFBBFRLL)");
   constexpr int SR_Part1 = 820;
   constexpr int SR_Part2 = 120;
 
-  const auto GetSeatId = [](const auto seat) {
-
-    int row = 128;
-    int col = 8;
-
-    std::pair<int, int> range{0, 127};
-
-    size_t i = 0;
-    while (i < 7) {
-      const auto c = seat[i];
-      const auto span = range.second - range.first + 1;
-      switch (c) {
-        case 'F':
-          range.second -= (span / 2);
-          row = range.second;
-          break;
-        case 'B':
-          range.first += (span / 2);
-          row = range.first;
-          break;
-        default:
-          throw std::runtime_error("Invalid input");
+  // Number of row and column characters in a boarding pass. The seat id is
+  // the pass read as a binary number, so the plane has
+  // 1 << (row_bits + col_bits) seats.
+  struct PlaneGeometry {
+    size_t row_bits;
+    size_t col_bits;
+
+    size_t code_size() const { return row_bits + col_bits; }
+    size_t seats() const { return size_t(1) << code_size(); }
+  };
+
+  constexpr PlaneGeometry DefaultGeometry{ 7, 3 };
+
+  // Every seat on a plane but `missing` and those before `first`, in a
+  // scrambled order, with a short line after `short_after` passes
+  std::string GeneratePasses(const PlaneGeometry& g, int first, int missing, size_t short_after) {
+    std::string s;
+    const int seats = int(g.seats());
+    for (int i = 0; i < seats; i++) {
+      // An odd multiplier permutes the ids
+      const int id = (i * 37) & (seats - 1);
+      if (id < first || id == missing) { continue; }
+      for (size_t b = g.code_size(); b-- > 0; ) {
+        const bool is_row = b >= g.col_bits;
+        s += (id >> b) & 1 ? (is_row ? 'B' : 'R') : (is_row ? 'F' : 'L');
       }
-      i++;
+      s += '\n';
+      if (!--short_after) { s += "FB\n"; }
     }
+    return s;
+  }
+
+  // One bit per seat, sized once for the plane
+  using SeatMap = std::vector<uint64_t>;
+
+  // Reverses the low `n` bits of `v`, n <= 16
+  constexpr int ReverseBits(uint32_t v, size_t n) {
+    v = ((v >> 1) & 0x5555) | ((v & 0x5555) << 1);
+    v = ((v >> 2) & 0x3333) | ((v & 0x3333) << 2);
+    v = ((v >> 4) & 0x0f0f) | ((v & 0x0f0f) << 4);
+    v = ((v >> 8) & 0x00ff) | ((v & 0x00ff) << 8);
+    return int(v >> (16 - n));
+  }
 
-    assert(range.first == range.second);
-
-    range = {0, 7};
-    while (i < seat.size()) {
-      const auto c = seat[i];
-      const auto span = range.second - range.first + 1;
-      switch (c) {
-        case 'L':
-          range.second -= (span / 2);
-          col = range.second;
-          break;
-        case 'R':
-          range.first += (span / 2);
-          col = range.first;
-          break;
-        default:
-          throw std::runtime_error("Invalid input");
+  // Maps F/L to 0 and B/R to 1. The first character is the most
+  // significant bit. Returns -1 on invalid characters.
+  class SeatDecoder {
+  public:
+    // Passes decoded together by decode_batch
+    static constexpr size_t Batch = 32;
+
+  private:
+    const PlaneGeometry geometry;
+#if defined(__SSSE3__)
+    __m128i reverse;
+    __m128i zeros;
+    __m128i ones;
+#endif
+#if defined(__AVX2__)
+    // Batch passes, newlines included, span `stride` vectors, and these are
+    // what each of those vectors should hold byte by byte. The newline is
+    // in both, so it's valid, and it's never read as part of an id.
+    std::vector<std::array<char, 32>> batch_zeros;
+    std::vector<std::array<char, 32>> batch_ones;
+#endif
+
+  public:
+    SeatDecoder(const PlaneGeometry& g)
+      : geometry(g)
+    {
+      if (!g.code_size() || g.code_size() > 16) { throw std::runtime_error("Unsupported plane geometry"); }
+#if defined(__SSSE3__)
+      // Byte i of the reversed code is character n - 1 - i, so that the
+      // movemask comes out with the first character as the top bit. Unused
+      // lanes shuffle in as 0, which counts as valid and never as a one.
+      alignas(16) std::array<char, 16> r;
+      alignas(16) std::array<char, 16> z;
+      alignas(16) std::array<char, 16> o;
+      const size_t n = g.code_size();
+      for (size_t i = 0; i < 16; i++) {
+        const bool used = i < n;
+        const bool is_row = used && (n - 1 - i) < g.row_bits;
+        r[i] = used ? char(n - 1 - i) : char(0x80);
+        z[i] = used ? (is_row ? 'F' : 'L') : 0;
+        o[i] = used ? (is_row ? 'B' : 'R') : 1;
+      }
+      reverse = _mm_load_si128(reinterpret_cast<const __m128i*>(r.data()));
+      zeros = _mm_load_si128(reinterpret_cast<const __m128i*>(z.data()));
+      ones = _mm_load_si128(reinterpret_cast<const __m128i*>(o.data()));
+#endif
+#if defined(__AVX2__)
+      const size_t stride = g.code_size() + 1;
+      batch_zeros.resize(stride);
+      batch_ones.resize(stride);
+      for (size_t p = 0; p < Batch * stride; p++) {
+        const size_t j = p % stride;
+        const bool is_row = j < g.row_bits;
+        const bool is_code = j < g.code_size();
+        batch_zeros[p / 32][p % 32] = is_code ? (is_row ? 'F' : 'L') : '\n';
+        batch_ones[p / 32][p % 32] = is_code ? (is_row ? 'B' : 'R') : '\n';
       }
-      i++;
+#endif
     }
 
-    assert(range.first == range.second);
+    // Decodes Batch newline terminated passes at a fixed stride into `ids`,
+    // with one compare pair and movemask per 32 bytes, i.e. about three
+    // passes at a time. `seats` must have Batch * (code_size() + 1) bytes.
+    // Returns false, having decoded nothing, unless every pass in the batch
+    // is valid and where it should be.
+    bool decode_batch(const char* seats, std::array<int, Batch>& ids) const {
+#if defined(__AVX2__)
+      const size_t n = geometry.code_size();
+      const size_t stride = n + 1;
+      // One bit per input byte, padded for the 8 byte reads below
+      std::array<uint32_t, 17 + 2> ones_bits{};
+      for (size_t k = 0; k < stride; k++) {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(seats + k * 32));
+        const __m256i is_one = _mm256_cmpeq_epi8(v,
+          _mm256_loadu_si256(reinterpret_cast<const __m256i*>(batch_ones[k].data())));
+        const __m256i is_zero = _mm256_cmpeq_epi8(v,
+          _mm256_loadu_si256(reinterpret_cast<const __m256i*>(batch_zeros[k].data())));
+        if (~_mm256_movemask_epi8(_mm256_or_si256(is_one, is_zero))) { return false; }
+        ones_bits[k] = _mm256_movemask_epi8(is_one);
+      }
+
+      // The first character is the lowest bit, but the most significant
+      const char* bits = reinterpret_cast<const char*>(ones_bits.data());
+      for (size_t i = 0; i < Batch; i++) {
+        const size_t at = i * stride;
+        uint64_t w;
+        std::memcpy(&w, bits + at / 8, sizeof(w));
+        ids[i] = ReverseBits(uint32_t(w >> (at % 8)) & ((1u << n) - 1), n);
+      }
+      return true;
+#else
+      (void)seats;
+      (void)ids;
+      return false;
+#endif
+    }
+
+    // `seat` must have at least 16 readable bytes for the vector path
+    int decode_wide(const char* seat) const {
+#if defined(__SSSE3__)
+      const __m128i v = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(seat)), reverse);
+      const __m128i is_one = _mm_cmpeq_epi8(v, ones);
+      const __m128i is_zero = _mm_cmpeq_epi8(v, zeros);
+      const int valid = _mm_movemask_epi8(_mm_or_si128(is_one, is_zero));
+      const int id = _mm_movemask_epi8(is_one);
+      return valid == 0xffff ? id : -1;
+#else
+      return decode(std::string_view(seat, geometry.code_size()));
+#endif
+    }
 
-    return row * 8 + col;
+    int decode(const std::string_view seat) const {
+      int id = 0;
+      bool valid = true;
+      for (size_t i = 0; i < seat.size(); i++) {
+        const char c = seat[i];
+        const bool is_row = i < geometry.row_bits;
+        const bool one = c == (is_row ? 'B' : 'R');
+        valid &= one | (c == (is_row ? 'F' : 'L'));
+        id = (id << 1) | one;
+      }
+      return valid ? id : -1;
+    }
   };
 
-  const auto LoadInput = [](auto f) {
+  // Returns the first unset seat after the first set one, of `seats`
+  const auto FindMissingSeat = [](const SeatMap& map, size_t seats) {
+    // Bits past the last seat in the last word aren't free seats
+    const auto free_in = [&](size_t w) {
+      const uint64_t tail = (w + 1) * 64 > seats ? ~(~uint64_t(0) << (seats % 64)) : ~uint64_t(0);
+      return ~map[w] & tail;
+    };
+
+    size_t w = 0;
+    while (w < map.size() && !map[w]) { w++; }
+    if (w == map.size()) { return -1; }
+
+    // Mask off everything up to and including the first set bit
+    const size_t first = w * 64 + __builtin_ctzll(map[w]);
+    uint64_t holes = free_in(w) & (~uint64_t(0) << (first % 64));
+    while (!holes && ++w < map.size()) {
+      holes = free_in(w);
+    }
+    if (w == map.size()) { return -1; }
+
+    return int(w * 64 + __builtin_ctzll(holes));
+  };
+
+  const auto LoadInput = [](std::string_view f, const PlaneGeometry& geometry) {
     Result r{0, 0};
     std::string_view line;
 
-    SeatMap map;
-    
-    while (aoc::getline(f, line)) {
-      if (line.size() != 10) {
+    const SeatDecoder decoder(geometry);
+    const size_t n = geometry.code_size();
+    const char* end = f.data() + f.size();
+    SeatMap map((geometry.seats() + 63) / 64, 0);
+
+    const auto add = [&](int id) {
+      r.first = std::max(id, r.first);
+      map[id / 64] |= uint64_t(1) << (id % 64);
+    };
+
+    // Whole batches while the passes come at a fixed stride, and line by
+    // line past anything irregular
+    const size_t batch_size = SeatDecoder::Batch * (n + 1);
+    std::array<int, SeatDecoder::Batch> ids;
+    while (!f.empty()) {
+      if (f.size() >= batch_size && decoder.decode_batch(f.data(), ids)) {
+        for (const auto& id : ids) { add(id); }
+        f.remove_prefix(batch_size);
         continue;
       }
 
-      const auto id = GetSeatId(line);
+      if (!aoc::getline(f, line)) { break; }
+      if (line.size() != n) {
+        continue;
+      }
 
-      r.first = std::max(id, r.first);
-      map.resize(r.first + 1);
-      map[id] = true;
+      const auto id = (end - line.data() >= 16) ? decoder.decode_wide(line.data()) : decoder.decode(line);
+      if (id < 0) {
+        throw std::runtime_error("Invalid input");
+      }
+      add(id);
     }
 
-    int i = 0;
-    while (!map[i]) { i++; }
-    while (map[i]) { i++; }
-    r.second = i;
+    r.second = FindMissingSeat(map, geometry.seats());
 
     return r;
   };
@@ -100,11 +260,16 @@ int main(int argc, char** argv) {
 
   Result r;
   if (inTest) {
-    r = LoadInput(SampleInput);
+    r = LoadInput(SampleInput, DefaultGeometry);
   } else {
+    PlaneGeometry geometry = DefaultGeometry;
+    if (argc > 3) {
+      geometry.row_bits = aoc::stoi(argv[2]);
+      geometry.col_bits = aoc::stoi(argv[3]);
+    }
     std::unique_ptr<MappedFileSource>m(new MappedFileSource(argc, argv));
     std::string_view f(m->data(), m->size());
-    r = LoadInput(f);
+    r = LoadInput(f, geometry);
   }
 
   int part1 = 0;
@@ -117,6 +282,18 @@ int main(int argc, char** argv) {
   if (inTest) {
     aoc::assert_result(part1, SR_Part1);
     aoc::assert_result(part2, SR_Part2);
+
+    // Enough passes for whole batches, interrupted by one short line
+    const auto many = LoadInput(GeneratePasses(DefaultGeometry, 10, 500, 100), DefaultGeometry);
+    aoc::assert_result(many.first, 1023);
+    aoc::assert_result(many.second, 500);
+
+    // A full eight seat plane has no missing seat, even though the bitmap
+    // word has room for more
+    constexpr PlaneGeometry Small{ 2, 1 };
+    const auto full = LoadInput(GeneratePasses(Small, 0, -1, 0), Small);
+    aoc::assert_result(full.first, 7);
+    aoc::assert_result(full.second, -1);
   }
 
   return 0;
@@ -1,14 +1,19 @@
 #include "aoc/helpers.h"
 
 #include <array>
+#include <cstring>
 #include <numeric>
+#include <thread>
+#include <vector>
+
+#if defined(__SSSE3__)
+#include <immintrin.h>
+#endif
 
 namespace {
   using Result = std::pair<int, int>;
   using MappedFileSource = aoc::MappedFileSource<char>;
 
-  using AnswerSet = std::array<int, 26>;
-
   constexpr std::string_view SampleInput(R"(abc
 
 a
@@ -27,38 +32,108 @@ b)");
   constexpr int SR_Part1 = 11;
   constexpr int SR_Part2 = 6;
 
+  constexpr uint32_t AllAnswers = (1u << 26) - 1;
+
+  // Turns a person's answers into a bitmask, bit n set for letter 'a' + n.
+  // 16 bytes at a time: a shuffle looks up 1 << (letter & 7), and each of
+  // the four bytes of the mask is an OR reduction over the letters whose
+  // (letter >> 3) selects it.
+  const auto GetAnswers = [](const std::string_view line) {
+    uint32_t mask = 0;
+    size_t i = 0;
+#if defined(__SSSE3__)
+    const __m128i pow2 = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+    const __m128i a = _mm_set1_epi8('a');
+    const __m128i seven = _mm_set1_epi8(7);
+    for (; i < line.size(); i += 16) {
+      std::array<char, 16> buf{};
+      std::memcpy(buf.data(), line.data() + i, std::min<size_t>(16, line.size() - i));
+      const __m128i idx = _mm_sub_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(buf.data())), a);
+      // Anything outside a..z is either negative or 26 and above
+      const __m128i valid = _mm_andnot_si128(_mm_cmplt_epi8(idx, _mm_setzero_si128()),
+        _mm_cmplt_epi8(idx, _mm_set1_epi8(26)));
+      const __m128i bit = _mm_and_si128(_mm_shuffle_epi8(pow2, _mm_and_si128(idx, seven)), valid);
+      const __m128i group = _mm_and_si128(_mm_srli_epi16(idx, 3), _mm_set1_epi8(3));
+      for (int k = 0; k < 4; k++) {
+        __m128i m = _mm_and_si128(bit, _mm_cmpeq_epi8(group, _mm_set1_epi8(k)));
+        m = _mm_or_si128(m, _mm_srli_si128(m, 8));
+        m = _mm_or_si128(m, _mm_srli_si128(m, 4));
+        m = _mm_or_si128(m, _mm_srli_si128(m, 2));
+        m = _mm_or_si128(m, _mm_srli_si128(m, 1));
+        mask |= uint32_t(_mm_cvtsi128_si32(m) & 0xff) << (k * 8);
+      }
+    }
+#else
+    for (; i < line.size(); i++) {
+      const uint32_t v = uint8_t(line[i] - 'a');
+      mask |= (v < 26 ? 1u : 0u) << (v & 31);
+    }
+#endif
+    return mask;
+  };
+
   const auto LoadInput = [](auto f) {
     Result r{0, 0};
     std::string_view line;
 
-    std::pair<AnswerSet, int> group;
+    uint32_t any = 0;
+    uint32_t all = AllAnswers;
     int sz = 0;
 
+    const auto end_group = [&]() {
+      r.first += __builtin_popcount(any);
+      r.second += sz ? __builtin_popcount(all) : 0;
+      any = 0;
+      all = AllAnswers;
+      sz = 0;
+    };
+
     while (aoc::getline(f, line, "\r\n", true)) {
       if (line.empty()) {
-        r.first += group.second;
-        r.second += std::accumulate(group.first.cbegin(), group.first.cend(), 0, [&sz](const auto& v, const auto& n) { return v + (n == sz); });
-        group.second = 0;
-        group.first = AnswerSet();
-        sz = 0;
+        end_group();
         continue;
       }
 
-      for (const auto &c : line) {
-        if (c < 'a' || c > 'z') {
-          continue;
-        }
-        int v = c - 'a';
-        group.second += (group.first[v] == 0);
-        group.first[v]++;
-      }
+      const auto answers = GetAnswers(line);
+      any |= answers;
+      all &= answers;
       sz ++;
     }
-    r.first += group.second;
-    r.second += std::accumulate(group.first.cbegin(), group.first.cend(), 0, [&sz](const auto& v, const auto& n) { return v + (n == sz); });
+    end_group();
 
     return r;
   };
+
+  // Splits the input into one chunk per thread, on blank lines so no group
+  // straddles two chunks, and sums the per chunk results.
+  constexpr size_t MinChunkSize = 1 << 20;
+
+  const auto LoadInputParallel = [](const std::string_view f) {
+    const size_t threads = std::max<size_t>(1, std::min<size_t>(
+      std::thread::hardware_concurrency(), f.size() / MinChunkSize));
+
+    std::vector<std::string_view> chunks;
+    size_t start = 0;
+    for (size_t t = 1; t < threads && start < f.size(); t++) {
+      const size_t split = f.find("\n\n", std::max(start, f.size() * t / threads));
+      if (split == std::string_view::npos) { break; }
+      chunks.push_back(f.substr(start, split - start));
+      start = split + 2;
+    }
+    chunks.push_back(f.substr(std::min(start, f.size())));
+
+    std::vector<Result> results(chunks.size());
+    std::vector<std::thread> workers;
+    for (size_t t = 1; t < chunks.size(); t++) {
+      workers.emplace_back([&, t]() { results[t] = LoadInput(chunks[t]); });
+    }
+    results[0] = LoadInput(chunks[0]);
+    for (auto& w : workers) { w.join(); }
+
+    return std::accumulate(results.cbegin(), results.cend(), Result{0, 0}, [](const auto& a, const auto& b) {
+      return Result{ a.first + b.first, a.second + b.second };
+    });
+  };
 }
 
 int main(int argc, char** argv) {
@@ -71,7 +146,7 @@ int main(int argc, char** argv) {
   } else {
     std::unique_ptr<MappedFileSource>m(new MappedFileSource(argc, argv));
     std::string_view f(m->data(), m->size());
-    r = LoadInput(f);
+    r = LoadInputParallel(f);
   }
 
   int part1 = 0;
@@ -1,7 +1,13 @@
 #include "aoc/helpers.h"
 
-#include <map>
-#include <set>
+#include <algorithm>
+#include <deque>
+#include <limits>
+#include <optional>
+#include <random>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
 namespace {
   constexpr std::string_view NO("no");
@@ -10,15 +16,71 @@ namespace {
   using Result = std::pair<int, int>;
   using MappedFileSource = aoc::MappedFileSource<char>;
 
-  using BagMap = std::map<std::string, int, std::less<>>;
-  
-  struct Bag {
-    BagMap contains;
-    BagMap contained_by;
+  // Colors are interned to dense ids as they are parsed. The names are views
+  // into the input, which must outlive the graph.
+  using BagId = uint32_t;
+
+  // Compressed sparse row adjacency: the edges of bag i are
+  // [offsets[i], offsets[i + 1]) in targets and weights.
+  struct Adjacency {
+    std::vector<uint32_t> offsets;
+    std::vector<BagId> targets;
+    std::vector<int> weights;
+
+    size_t begin(BagId id) const { return offsets[id]; }
+    size_t end(BagId id) const { return offsets[id + 1]; }
+  };
+
+  struct Rule {
+    BagId outer;
+    BagId inner;
+    int count;
+  };
+
+  struct BagGraph {
+    std::vector<std::string_view> names;
+    std::unordered_map<std::string_view, BagId> ids;
+    std::vector<Rule> rules;
+    Adjacency contains;
+    Adjacency contained_by;
+
+    BagId intern(const std::string_view color) {
+      const auto r = ids.emplace(color, names.size());
+      if (r.second) { names.push_back(color); }
+      return r.first->second;
+    }
+
+    BagId find(const std::string_view color) const {
+      const auto r = ids.find(color);
+      if (r == ids.end()) { throw std::runtime_error("Unknown bag color"); }
+      return r->second;
+    }
+
+    size_t size() const { return names.size(); }
   };
 
-  using BagsMap = std::map<std::string, Bag, std::less<>>;
-  using BagSet = std::set<std::string, std::less<>>;
+  // Counting sort of the rules by `key` into CSR form
+  template<typename Key, typename Value>
+  Adjacency BuildAdjacency(const std::vector<Rule>& rules, size_t n, Key key, Value value) {
+    Adjacency adj;
+    adj.offsets.assign(n + 1, 0);
+    for (const auto& r : rules) {
+      adj.offsets[key(r) + 1]++;
+    }
+    for (size_t i = 0; i < n; i++) {
+      adj.offsets[i + 1] += adj.offsets[i];
+    }
+
+    adj.targets.resize(rules.size());
+    adj.weights.resize(rules.size());
+    std::vector<uint32_t> fill(adj.offsets.begin(), adj.offsets.end() - 1);
+    for (const auto& r : rules) {
+      const auto pos = fill[key(r)]++;
+      adj.targets[pos] = value(r);
+      adj.weights[pos] = r.count;
+    }
+    return adj;
+  }
 
   const auto GetBagColor = [](auto& bag) {
     std::string_view color = bag;
@@ -34,7 +96,7 @@ namespace {
     return color.substr(0, length);
   };
 
-  const auto ParseBagLine = [](auto& bagline, BagsMap& bags) {
+  const auto ParseBagLine = [](auto& bagline, BagGraph& bags) {
     const auto color = GetBagColor(bagline);
     
     size_t pos = 2;
@@ -42,29 +104,21 @@ namespace {
     while (pos < 4 && aoc::getline(bagline, part, " ")) {
       pos++;
     }
-    Bag b;
-    auto f = bags.emplace(color, b);
-    auto& bag = f.first->second;
+    const BagId outer = bags.intern(color);
 
     while (aoc::getline(bagline, part, ",.")) {
       std::string_view p;
-      std::string col;
       aoc::getline(part, p, " ");
       if (p == NO) {
         DEBUG_PRINT(color << " is leaf");
         continue;
       }
       int num = aoc::stoi(p);
-      col = GetBagColor(part);
+      const auto col = GetBagColor(part);
 
       DEBUG_PRINT(color << " contains " << num << " " << col);
-      bag.contains.insert(std::make_pair(col, num));
-      f = bags.emplace(col, b);
-      f.first->second.contained_by.insert(std::make_pair(std::string(color), num));
-      DEBUG_PRINT(col << " contained_by " << color);
+      bags.rules.push_back({ outer, bags.intern(col), num });
     }
-
-    return bags;
   };
 
   constexpr std::string_view SampleInput(R"(light red bags contain 1 bright white bag, 2 muted yellow bags.
@@ -76,69 +130,737 @@ dark olive bags contain 3 faded blue bags, 4 dotted black bags.
 vibrant plum bags contain 5 faded blue bags, 6 dotted black bags.
 faded blue bags contain no other bags.
 dotted black bags contain no other bags.)");
-  constexpr int SR_Part1 = 4;
-  constexpr int SR_Part2 = 32;
+  constexpr size_t SR_Part1 = 4;
+  constexpr uint64_t SR_Part2 = 32;
 
   const auto LoadInput = [](auto f) {
-    BagsMap rules;
+    BagGraph rules;
     std::string_view line;
     while (aoc::getline(f, line)) {
       ParseBagLine(line, rules);
     }
+
+    const auto n = rules.size();
+    rules.contains = BuildAdjacency(rules.rules, n,
+      [](const Rule& r) { return r.outer; }, [](const Rule& r) { return r.inner; });
+    rules.contained_by = BuildAdjacency(rules.rules, n,
+      [](const Rule& r) { return r.inner; }, [](const Rule& r) { return r.outer; });
+
     return rules;
   };
 
-  void GetContainedBy(const std::string_view color, const BagsMap& bags, BagSet& set) {
-    const auto r = bags.find(color);
-    assert(r != bags.end());
-    if (r == bags.end()) { return; }
+  // One bit per bag id
+  class BagSet {
+    std::vector<uint64_t> words;
+
+  public:
+    BagSet(size_t n)
+      : words((n + 63) / 64, 0)
+    { }
+
+    bool test(BagId id) const { return words[id / 64] >> (id % 64) & 1; }
+    void set(BagId id) { words[id / 64] |= uint64_t(1) << (id % 64); }
+
+    BagSet& operator|=(const BagSet& o) {
+      for (size_t i = 0; i < words.size(); i++) { words[i] |= o.words[i]; }
+      return *this;
+    }
+
+    size_t count() const {
+      size_t n = 0;
+      for (const auto& w : words) { n += __builtin_popcountll(w); }
+      return n;
+    }
+  };
+
+  // The set of bags that can eventually contain `color`
+  BagSet GetContainedBy(const BagId color, const BagGraph& bags) {
+    BagSet seen(bags.size());
+    std::vector<BagId> stack{ color };
+
+    while (!stack.empty()) {
+      const auto id = stack.back();
+      stack.pop_back();
+
+      const auto& adj = bags.contained_by;
+      for (size_t e = adj.begin(id); e < adj.end(id); e++) {
+        const auto c = adj.targets[e];
+        if (seen.test(c)) { continue; }
+        seen.set(c);
+        stack.push_back(c);
+      }
+    }
+
+    return seen;
+  }
+
+  // Bags ordered so that every bag comes before the bags it contains.
+  // Throws if the rules are cyclic.
+  std::vector<BagId> GetTopologicalOrder(const BagGraph& bags) {
+    const auto& adj = bags.contains;
+    std::vector<uint32_t> in_degree(bags.size(), 0);
+    for (const auto& t : adj.targets) {
+      in_degree[t]++;
+    }
+
+    std::vector<BagId> order;
+    order.reserve(bags.size());
+    for (BagId id = 0; id < bags.size(); id++) {
+      if (!in_degree[id]) { order.push_back(id); }
+    }
+
+    for (size_t i = 0; i < order.size(); i++) {
+      const auto id = order[i];
+      for (size_t e = adj.begin(id); e < adj.end(id); e++) {
+        if (!--in_degree[adj.targets[e]]) {
+          order.push_back(adj.targets[e]);
+        }
+      }
+    }
+
+    if (order.size() != bags.size()) {
+      throw std::runtime_error("Bag rules contain a cycle");
+    }
+
+    return order;
+  }
+
+  // Bag counts saturate rather than wrap on absurdly deep rule sets
+  using Count = uint64_t;
+  constexpr Count MaxCount = std::numeric_limits<Count>::max();
+
+  const auto SaturatingMulAdd = [](Count a, Count b, Count c) {
+    Count r;
+    if (__builtin_mul_overflow(a, b, &r) || __builtin_add_overflow(r, c, &r)) {
+      return MaxCount;
+    }
+    return r;
+  };
+
+  // Total number of bags inside every bag, evaluated leaves first so each
+  // bag is computed once from its direct contents.
+  std::vector<Count> GetAllContents(const BagGraph& bags) {
+    const auto order = GetTopologicalOrder(bags);
+    const auto& adj = bags.contains;
+    std::vector<Count> totals(bags.size(), 0);
+
+    for (auto it = order.rbegin(); it != order.rend(); it++) {
+      Count total = 0;
+      for (size_t e = adj.begin(*it); e < adj.end(*it); e++) {
+        const auto inner = totals[adj.targets[e]];
+        total = SaturatingMulAdd(adj.weights[e], inner == MaxCount ? inner : inner + 1, total);
+      }
+      totals[*it] = total;
+    }
+
+    return totals;
+  }
+
+  // Strongly connected components of the contains graph. Components are
+  // numbered in the order Tarjan's algorithm completes them, so every
+  // component comes after the components it contains.
+  struct Condensation {
+    std::vector<uint32_t> component;
+    // Members of component c are members[offsets[c], offsets[c + 1])
+    std::vector<uint32_t> offsets;
+    std::vector<BagId> members;
+    // More than one member, or a bag that contains itself
+    std::vector<bool> cyclic;
+
+    size_t size() const { return offsets.size() - 1; }
+  };
+
+  Condensation Condense(const BagGraph& bags) {
+    constexpr uint32_t Unvisited = std::numeric_limits<uint32_t>::max();
+    const auto& adj = bags.contains;
+    const size_t n = bags.size();
+
+    Condensation c;
+    c.component.assign(n, Unvisited);
+    c.offsets.push_back(0);
+
+    std::vector<uint32_t> index(n, Unvisited);
+    std::vector<uint32_t> low(n, 0);
+    std::vector<bool> on_stack(n, false);
+    std::vector<BagId> stack;
+    // (bag, next edge to visit) in place of recursion
+    std::vector<std::pair<BagId, size_t>> calls;
+    uint32_t next = 0;
+
+    const auto visit = [&](BagId v) {
+      index[v] = low[v] = next++;
+      stack.push_back(v);
+      on_stack[v] = true;
+      calls.emplace_back(v, adj.begin(v));
+    };
+
+    for (BagId root = 0; root < n; root++) {
+      if (index[root] != Unvisited) { continue; }
+      visit(root);
+
+      while (!calls.empty()) {
+        const BagId v = calls.back().first;
+        const size_t e = calls.back().second;
+        if (e < adj.end(v)) {
+          calls.back().second++;
+          const BagId w = adj.targets[e];
+          if (index[w] == Unvisited) {
+            visit(w);
+          } else if (on_stack[w]) {
+            low[v] = std::min(low[v], index[w]);
+          }
+          continue;
+        }
+
+        calls.pop_back();
+        if (!calls.empty()) {
+          const BagId u = calls.back().first;
+          low[u] = std::min(low[u], low[v]);
+        }
+
+        if (low[v] == index[v]) {
+          const uint32_t id = c.size();
+          BagId w;
+          do {
+            w = stack.back();
+            stack.pop_back();
+            on_stack[w] = false;
+            c.component[w] = id;
+            c.members.push_back(w);
+          } while (w != v);
+          c.offsets.push_back(c.members.size());
+        }
+      }
+    }
+
+    c.cyclic.assign(c.size(), false);
+    for (uint32_t id = 0; id < c.size(); id++) {
+      c.cyclic[id] = c.offsets[id + 1] - c.offsets[id] > 1;
+    }
+    for (BagId v = 0; v < n; v++) {
+      for (size_t e = adj.begin(v); e < adj.end(v); e++) {
+        if (adj.targets[e] == v) { c.cyclic[c.component[v]] = true; }
+      }
+    }
+
+    return c;
+  }
+
+  // Runs f(i) for i in [0, n), split into contiguous ranges across threads
+  // when there is enough work to be worth it.
+  template<typename F>
+  void ParallelFor(size_t n, F f) {
+    constexpr size_t MinGrain = 64;
+    const size_t threads = std::max<size_t>(1, std::min<size_t>(
+      std::thread::hardware_concurrency(), n / MinGrain));
+
+    const auto run = [&](size_t t) {
+      for (size_t i = n * t / threads; i < n * (t + 1) / threads; i++) {
+        f(i);
+      }
+    };
+
+    std::vector<std::thread> workers;
+    for (size_t t = 1; t < threads; t++) {
+      workers.emplace_back(run, t);
+    }
+    run(0);
+    for (auto& w : workers) { w.join(); }
+  }
+
+  // Everything needed to answer "how many bags can contain X" and "how many
+  // bags are inside Y" for any X and Y without touching the graph again.
+  struct ClosureIndex {
+    Condensation scc;
+    // Bags that can eventually contain each component
+    std::vector<BagSet> ancestors;
+    std::vector<size_t> ancestor_count;
+    // Per bag content totals, MaxCount if the bag reaches a cycle
+    std::vector<Count> contents;
+
+    size_t containers_of(BagId id) const { return ancestor_count[scc.component[id]]; }
+    Count contents_of(BagId id) const { return contents[id]; }
+  };
+
+  ClosureIndex BuildClosureIndex(const BagGraph& bags) {
+    ClosureIndex index;
+    auto& scc = index.scc;
+    scc = Condense(bags);
+    const size_t n = scc.size();
+
+    // Contents, components that contain nothing first
+    index.contents.assign(bags.size(), 0);
+    for (uint32_t c = 0; c < n; c++) {
+      for (auto m = scc.offsets[c]; m < scc.offsets[c + 1]; m++) {
+        const auto id = scc.members[m];
+        Count total = scc.cyclic[c] ? MaxCount : 0;
+        for (size_t e = bags.contains.begin(id); e < bags.contains.end(id) && total != MaxCount; e++) {
+          const auto inner = index.contents[bags.contains.targets[e]];
+          total = SaturatingMulAdd(bags.contains.weights[e], inner == MaxCount ? inner : inner + 1, total);
+        }
+        index.contents[id] = total;
+      }
+    }
+
+    // Level of a component is the longest chain of components containing it,
+    // so every component only depends on components from earlier levels.
+    std::vector<uint32_t> level(n, 0);
+    uint32_t levels = n ? 1 : 0;
+    for (uint32_t c = n; c-- > 0; ) {
+      for (auto m = scc.offsets[c]; m < scc.offsets[c + 1]; m++) {
+        const auto id = scc.members[m];
+        for (size_t e = bags.contains.begin(id); e < bags.contains.end(id); e++) {
+          const auto d = scc.component[bags.contains.targets[e]];
+          if (d == c) { continue; }
+          level[d] = std::max(level[d], level[c] + 1);
+          levels = std::max(levels, level[d] + 1);
+        }
+      }
+    }
+
+    std::vector<uint32_t> by_level_offsets(levels + 1, 0);
+    for (const auto& l : level) { by_level_offsets[l + 1]++; }
+    for (uint32_t l = 0; l < levels; l++) { by_level_offsets[l + 1] += by_level_offsets[l]; }
+    std::vector<uint32_t> by_level(n);
+    {
+      std::vector<uint32_t> fill(by_level_offsets.begin(), by_level_offsets.end() - 1);
+      for (uint32_t c = 0; c < n; c++) { by_level[fill[level[c]]++] = c; }
+    }
+
+    index.ancestors.assign(n, BagSet(bags.size()));
+    index.ancestor_count.assign(n, 0);
+    for (uint32_t l = 0; l < levels; l++) {
+      const auto first = by_level_offsets[l];
+      ParallelFor(by_level_offsets[l + 1] - first, [&](size_t i) {
+        const auto c = by_level[first + i];
+        auto& set = index.ancestors[c];
+        for (auto m = scc.offsets[c]; m < scc.offsets[c + 1]; m++) {
+          const auto id = scc.members[m];
+          if (scc.cyclic[c]) { set.set(id); }
+          for (size_t e = bags.contained_by.begin(id); e < bags.contained_by.end(id); e++) {
+            const auto outer = bags.contained_by.targets[e];
+            const auto p = scc.component[outer];
+            if (p == c) { continue; }
+            set.set(outer);
+            set |= index.ancestors[p];
+          }
+        }
+        index.ancestor_count[c] = set.count();
+      });
+    }
+
+    return index;
+  }
+
+  STRING_CONSTANT(SERVE, "serve");
+  STRING_CONSTANT(CONTAINERS, "containers");
+  STRING_CONSTANT(CONTENTS, "contents");
+
+  // Answers one query per line, "containers <color>" or "contents <color>"
+  void ServeQueries(std::istream& in, std::ostream& out, const BagGraph& bags, const ClosureIndex& index) {
+    std::string line;
+    while (aoc::getline(in, line)) {
+      std::string_view query(line);
+      std::string_view kind;
+      aoc::getline(query, kind, ' ');
+
+      const auto r = bags.ids.find(query);
+      if (r == bags.ids.end()) {
+        out << "unknown color: " << query << std::endl;
+      } else if (kind == CONTAINERS) {
+        out << index.containers_of(r->second) << "\n";
+      } else if (kind == CONTENTS) {
+        out << index.contents_of(r->second) << "\n";
+      } else {
+        out << "unknown query: " << kind << std::endl;
+      }
+    }
+    out.flush();
+  }
+
+  // Rules that can be edited in place. Content totals and ancestor counts
+  // are cached per bag and computed on demand; an edit to a bag's rule only
+  // invalidates the totals of the bags that can contain it (its up-cone) and
+  // the ancestor counts of the bags it can contain (its down-cone).
+  // Traversals mark bags with an epoch stamp rather than a fresh array, so
+  // an edit or a query costs time in its cones, not in the whole graph.
+  class IncrementalRules {
+    using Contents = std::vector<std::pair<BagId, int>>;
+
+    std::vector<std::string_view> names;
+    std::unordered_map<std::string_view, BagId> ids;
+    // Storage for colors that first appear in an edit
+    std::deque<std::string> owned;
+
+    std::vector<Contents> contains;
+    std::vector<std::vector<BagId>> contained_by;
+
+    // A valid total implies the totals of everything it contains are valid
+    std::vector<Count> contents;
+    std::vector<bool> contents_valid;
+    std::vector<size_t> ancestors;
+    std::vector<bool> ancestors_valid;
+
+    // A bag is marked in the current traversal if its stamp is the epoch
+    std::vector<uint32_t> visited;
+    uint32_t epoch;
+
+    uint32_t next_epoch() {
+      if (++epoch == 0) {
+        std::fill(visited.begin(), visited.end(), 0);
+        epoch = 1;
+      }
+      return epoch;
+    }
+
+  public:
+    explicit IncrementalRules(const BagGraph& bags)
+      : names(bags.names)
+      , ids(bags.ids)
+      , contains(bags.size())
+      , contained_by(bags.size())
+      , contents(bags.size(), 0)
+      , contents_valid(bags.size(), false)
+      , ancestors(bags.size(), 0)
+      , ancestors_valid(bags.size(), false)
+      , visited(bags.size(), 0)
+      , epoch(0)
+    {
+      for (const auto& r : bags.rules) {
+        contains[r.outer].emplace_back(r.inner, r.count);
+        contained_by[r.inner].push_back(r.outer);
+      }
+    }
+
+    bool find(const std::string_view color, BagId& id) const {
+      const auto r = ids.find(color);
+      if (r == ids.end()) { return false; }
+      id = r->second;
+      return true;
+    }
+
+    BagId intern(const std::string_view color) {
+      BagId id;
+      if (find(color, id)) { return id; }
+
+      owned.emplace_back(color);
+      id = names.size();
+      names.push_back(owned.back());
+      ids.emplace(names.back(), id);
+      contains.emplace_back();
+      contained_by.emplace_back();
+      contents.push_back(0);
+      contents_valid.push_back(false);
+      ancestors.push_back(0);
+      ancestors_valid.push_back(false);
+      visited.push_back(0);
+      return id;
+    }
+
+    // Replaces everything `outer` contains. An empty `inner` removes the rule.
+    void set_rule(BagId outer, Contents inner) {
+      // Up-cone: stop at bags that are already invalid, their own up-cone
+      // is invalid too.
+      std::vector<BagId> stack{ outer };
+      while (!stack.empty()) {
+        const auto id = stack.back();
+        stack.pop_back();
+        if (!contents_valid[id]) { continue; }
+        contents_valid[id] = false;
+        stack.insert(stack.end(), contained_by[id].begin(), contained_by[id].end());
+      }
+      contents_valid[outer] = false;
+
+      for (const auto& c : contains[outer]) {
+        auto& parents = contained_by[c.first];
+        parents.erase(std::find(parents.begin(), parents.end(), outer));
+        stack.push_back(c.first);
+      }
+      for (const auto& c : inner) {
+        contained_by[c.first].push_back(outer);
+        stack.push_back(c.first);
+      }
+      contains[outer] = std::move(inner);
+
+      // Down-cone from both the old and the new contents. A bag whose count
+      // is already invalid can still have valid ones below it, so this
+      // can't stop early the way the up-cone does.
+      const uint32_t stamp = next_epoch();
+      while (!stack.empty()) {
+        const auto id = stack.back();
+        stack.pop_back();
+        if (visited[id] == stamp) { continue; }
+        visited[id] = stamp;
+        ancestors_valid[id] = false;
+        for (const auto& c : contains[id]) { stack.push_back(c.first); }
+      }
+    }
+
+    // Total number of bags inside `color`, MaxCount if it reaches a cycle
+    Count contents_of(BagId color) {
+      if (contents_valid[color]) { return contents[color]; }
+
+      // (bag, next edge) in place of recursion. A bag still on this stack
+      // when it is reached again is on a cycle.
+      std::vector<std::pair<BagId, size_t>> calls{ { color, 0 } };
+      const uint32_t stamp = next_epoch();
+      const auto active = [&](BagId id) { return visited[id] == stamp; };
+      visited[color] = stamp;
+      contents[color] = 0;
+
+      while (!calls.empty()) {
+        const auto id = calls.back().first;
+        const auto e = calls.back().second;
+        if (e < contains[id].size()) {
+          const auto inner = contains[id][e].first;
+          if (!contents_valid[inner] && !active(inner)) {
+            visited[inner] = stamp;
+            contents[inner] = 0;
+            calls.emplace_back(inner, 0);
+            continue;
+          }
+          const auto total = active(inner) ? MaxCount : contents[inner];
+          contents[id] = SaturatingMulAdd(contains[id][e].second, total == MaxCount ? total : total + 1, contents[id]);
+          calls.back().second++;
+          continue;
+        }
+
+        visited[id] = 0;
+        contents_valid[id] = true;
+        calls.pop_back();
+        if (!calls.empty()) {
+          // Fold the finished bag into its parent and move to the next edge
+          const auto parent = calls.back().first;
+          auto& pe = calls.back().second;
+          const auto total = contents[id];
+          contents[parent] = SaturatingMulAdd(contains[parent][pe].second, total == MaxCount ? total : total + 1, contents[parent]);
+          pe++;
+        }
+      }
+
+      return contents[color];
+    }
+
+    // Number of distinct bags that can eventually contain `color`
+    size_t containers_of(BagId color) {
+      if (ancestors_valid[color]) { return ancestors[color]; }
+
+      const uint32_t stamp = next_epoch();
+      size_t count = 0;
+      std::vector<BagId> stack{ color };
+      while (!stack.empty()) {
+        const auto id = stack.back();
+        stack.pop_back();
+        for (const auto& c : contained_by[id]) {
+          if (visited[c] == stamp) { continue; }
+          visited[c] = stamp;
+          count++;
+          stack.push_back(c);
+        }
+      }
+
+      ancestors[color] = count;
+      ancestors_valid[color] = true;
+      return count;
+    }
+
+    size_t size() const { return names.size(); }
+  };
+
+  STRING_CONSTANT(UPDATE, "update");
+  STRING_CONSTANT(RULE, "rule");
+  STRING_CONSTANT(REMOVE, "remove");
+
+  // Parses a single "<color> bags contain ..." line into edits for `rules`
+  const auto ParseRuleEdit = [](std::string_view line, IncrementalRules& rules) {
+    BagGraph parsed;
+    ParseBagLine(line, parsed);
+    if (parsed.names.empty()) { throw std::runtime_error("Invalid rule"); }
+
+    std::vector<std::pair<BagId, int>> inner;
+    for (const auto& r : parsed.rules) {
+      inner.emplace_back(rules.intern(parsed.names[r.inner]), r.count);
+    }
+    return std::make_pair(rules.intern(parsed.names[0]), inner);
+  };
+
+  // Like ServeQueries, plus "rule <rule line>" to add or replace a rule and
+  // "remove <color>" to drop one.
+  void ServeUpdates(std::istream& in, std::ostream& out, IncrementalRules& rules) {
+    std::string line;
+    while (aoc::getline(in, line)) {
+      std::string_view query(line);
+      std::string_view kind;
+      aoc::getline(query, kind, ' ');
+
+      if (kind == RULE) {
+        auto edit = ParseRuleEdit(query, rules);
+        rules.set_rule(edit.first, std::move(edit.second));
+        continue;
+      }
 
-    const auto& bag = r->second;
-    for (const auto& c : bag.contained_by) {
-      set.insert(c.first);
-      GetContainedBy(c.first, bags, set);
+      BagId id;
+      if (!rules.find(query, id)) {
+        out << "unknown color: " << query << std::endl;
+      } else if (kind == REMOVE) {
+        rules.set_rule(id, {});
+      } else if (kind == CONTAINERS) {
+        out << rules.containers_of(id) << "\n";
+      } else if (kind == CONTENTS) {
+        out << rules.contents_of(id) << "\n";
+      } else {
+        out << "unknown query: " << kind << std::endl;
+      }
     }
+    out.flush();
   }
 
-  void GetContentsOf(const std::string_view color, const BagsMap& bags, int& total, int n) {
-    const auto r = bags.find(color);
-    assert(r != bags.end());
-    if (r == bags.end()) { return; }
+  STRING_CONSTANT(BENCH_UPDATES, "bench-updates");
+
+  // Generates a layered DAG of `n` bags, applies random rule edits and
+  // compares answering queries incrementally against rebuilding the CSR
+  // graph and rerunning both traversals after every edit.
+  void BenchmarkUpdates(size_t n, size_t edits) {
+    constexpr size_t Fanout = 3;
+    constexpr size_t Reach = 1000;
+    std::mt19937 rng(2020);
 
-    const auto& bag = r->second;
-    for (const auto& c : bag.contains) {
-      const int num = (n * c.second);
-      total += num;
-      GetContentsOf(c.first, bags, total, num);
+    const auto name = [](size_t i) { return "b" + std::to_string(i) + " x"; };
+    const auto random_contents = [&](size_t i) {
+      std::vector<std::pair<size_t, int>> inner;
+      for (size_t k = 0; k < Fanout && i + 1 < n; k++) {
+        const size_t c = i + 1 + rng() % std::min(Reach, n - i - 1);
+        if (std::find_if(inner.begin(), inner.end(), [c](const auto& p) { return p.first == c; }) == inner.end()) {
+          inner.emplace_back(c, 1 + rng() % 3);
+        }
+      }
+      return inner;
+    };
+
+    std::string text;
+    for (size_t i = 0; i < n; i++) {
+      const auto inner = random_contents(i);
+      text += name(i) + " bags contain ";
+      if (inner.empty()) { text += "no other bags"; }
+      for (size_t k = 0; k < inner.size(); k++) {
+        text += (k ? ", " : "") + std::to_string(inner[k].second) + " " + name(inner[k].first) + " bags";
+      }
+      text += ".\n";
     }
+
+    BagGraph full = LoadInput(std::string_view(text));
+    IncrementalRules incremental(full);
+    IncrementalRules edits_only(full);
+
+    // Edits to apply, and the bags queried after each one
+    std::vector<std::pair<BagId, std::vector<std::pair<BagId, int>>>> plan;
+    for (size_t e = 0; e < edits; e++) {
+      const size_t outer = rng() % n;
+      std::vector<std::pair<BagId, int>> inner;
+      for (const auto& c : random_contents(outer)) {
+        inner.emplace_back(full.find(name(c.first)), c.second);
+      }
+      plan.emplace_back(full.find(name(outer)), inner);
+    }
+    const BagId top = full.find(name(0));
+    const BagId middle = full.find(name(n / 2));
+
+    std::vector<std::pair<size_t, Count>> expected;
+    {
+      aoc::AutoTimer t("full rebuild");
+      for (const auto& p : plan) {
+        auto& rules = full.rules;
+        rules.erase(std::remove_if(rules.begin(), rules.end(), [&](const Rule& r) { return r.outer == p.first; }), rules.end());
+        for (const auto& c : p.second) {
+          rules.push_back({ p.first, c.first, c.second });
+        }
+        full.contains = BuildAdjacency(rules, full.size(),
+          [](const Rule& r) { return r.outer; }, [](const Rule& r) { return r.inner; });
+        full.contained_by = BuildAdjacency(rules, full.size(),
+          [](const Rule& r) { return r.inner; }, [](const Rule& r) { return r.outer; });
+        expected.emplace_back(GetContainedBy(middle, full).count(), GetAllContents(full)[top]);
+      }
+    }
+
+    {
+      aoc::AutoTimer t("incremental edits only");
+      for (const auto& p : plan) {
+        edits_only.set_rule(p.first, p.second);
+      }
+    }
+
+    std::vector<std::pair<size_t, Count>> got;
+    {
+      aoc::AutoTimer t("incremental edits and queries");
+      for (const auto& p : plan) {
+        incremental.set_rule(p.first, p.second);
+        got.emplace_back(incremental.containers_of(middle), incremental.contents_of(top));
+      }
+    }
+
+    std::cout << n << " bags, " << edits << " edits: results " << (got == expected ? "match" : "DIFFER") << std::endl;
   }
 }
 
 int main(int argc, char** argv) {
-  aoc::AutoTimer t;
+  if (argc > 1 && BENCH_UPDATES == argv[1]) {
+    const size_t n = argc > 2 ? aoc::stoi(argv[2]) : 100000;
+    const size_t edits = argc > 3 ? aoc::stoi(argv[3]) : 100;
+    BenchmarkUpdates(n, edits);
+    return 0;
+  }
+
+  // The query modes answer one line per query on stdout, so they mustn't
+  // print timings there
+  const bool serving = argc > 2 && (SERVE == argv[2] || UPDATE == argv[2]);
+  std::optional<aoc::AutoTimer> t;
+  if (!serving) { t.emplace(); }
   const bool inTest = argc < 2;
 
-  BagsMap r;
+  // Bag names are views into the input, so keep it mapped
+  std::unique_ptr<MappedFileSource> m;
+  BagGraph r;
   if (inTest) {
     r = LoadInput(SampleInput);
   } else {
-    std::unique_ptr<MappedFileSource>m(new MappedFileSource(argc, argv));
+    m.reset(new MappedFileSource(argc, argv));
     std::string_view f(m->data(), m->size());
     r = LoadInput(f);
   }
 
-  BagSet containers;
-  GetContainedBy(SHINY_GOLD, r, containers);
-  int part1 = containers.size();
+  if (argc > 2 && SERVE == argv[2]) {
+    const auto index = BuildClosureIndex(r);
+    ServeQueries(std::cin, std::cout, r, index);
+    return 0;
+  }
+
+  if (argc > 2 && UPDATE == argv[2]) {
+    IncrementalRules rules(r);
+    ServeUpdates(std::cin, std::cout, rules);
+    return 0;
+  }
 
-  int part2 = 0;
-  GetContentsOf(SHINY_GOLD, r, part2, 1);
+  const auto shiny_gold = r.find(SHINY_GOLD);
+  size_t part1 = GetContainedBy(shiny_gold, r).count();
+  Count part2 = GetAllContents(r)[shiny_gold];
 
   aoc::print_results(part1, part2);
 
   if (inTest) {
     aoc::assert_result(part1, SR_Part1);
     aoc::assert_result(part2, SR_Part2);
+
+    const auto index = BuildClosureIndex(r);
+    aoc::assert_result(index.containers_of(shiny_gold), SR_Part1);
+    aoc::assert_result(index.contents_of(shiny_gold), SR_Part2);
+
+    IncrementalRules rules(r);
+    aoc::assert_result(rules.containers_of(shiny_gold), SR_Part1);
+    aoc::assert_result(rules.contents_of(shiny_gold), SR_Part2);
+    auto edit = ParseRuleEdit("shiny gold bags contain 2 dark olive bags.", rules);
+    rules.set_rule(edit.first, std::move(edit.second));
+    aoc::assert_result(rules.contents_of(shiny_gold), Count(16));
+    aoc::assert_result(rules.containers_of(r.find("vibrant plum")), size_t(0));
   }
 
   return 0;
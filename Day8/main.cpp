@@ -1,7 +1,10 @@
 #include "aoc/helpers.h"
 
-#include <vector>
+#include <algorithm>
 #include <map>
+#include <numeric>
+#include <random>
+#include <vector>
 
 namespace {
   using MappedFileSource = aoc::MappedFileSource<char>;
@@ -18,7 +21,21 @@ acc +6)");
   constexpr int SR_Part1 = 5;
   constexpr int SR_Part2 = 8;
 
-  enum class Opcode {
+  // Already terminates with 4. Flipping the jmp runs the acc +5 as well
+  // and terminates with 9, while making the nop +0 a jmp +0 would loop.
+  constexpr std::string_view HaltingInput(R"(nop +0
+acc +1
+jmp +2
+acc +5
+acc +3)");
+
+  STRING_CONSTANT(REPAIRS, "repairs");
+  STRING_CONSTANT(BENCH_VM, "bench-vm");
+  STRING_CONSTANT(STEPS, "steps");
+
+  // Opcode values index the interpreter's dispatch table, so new opcodes
+  // are appended here, in OpCodeMap and in Machine::run.
+  enum class Opcode : uint8_t {
     ACC,
     JMP,
     NOP,
@@ -38,9 +55,27 @@ acc +6)");
     return r->second;
   };
 
-  using Instruction = std::tuple<Opcode, int, bool>;
+  // Instructions are packed into 32 bits: the opcode in the low byte and a
+  // signed 24 bit argument above it. The program is immutable; per-run state
+  // lives in the Machine.
+  using Instruction = uint32_t;
   using Program = std::vector<Instruction>;
 
+  constexpr int MaxArg = (1 << 23) - 1;
+  constexpr int MinArg = -(1 << 23);
+
+  constexpr Instruction Encode(Opcode op, int arg) {
+    return (uint32_t(arg) << 8) | uint32_t(op);
+  }
+
+  constexpr Opcode OpcodeOf(Instruction i) {
+    return static_cast<Opcode>(i & 0xff);
+  }
+
+  constexpr int ArgOf(Instruction i) {
+    return int32_t(i) >> 8;
+  }
+
   const auto LoadInput = [](auto f) {
     Program prog;
     std::string_view line;
@@ -62,7 +97,11 @@ acc +6)");
 
       DEBUG_PRINT(s << " " << arg);
 
-      prog.emplace_back(op, arg, false);
+      if (arg < MinArg || arg > MaxArg) {
+        throw std::runtime_error("Argument out of range");
+      }
+
+      prog.push_back(Encode(op, arg));
     }
     return prog;
   };
@@ -73,39 +112,420 @@ acc +6)");
     Error,
   };
 
-  TermCode RunProgram(Program program, int& acc) {
+  // Runs programs with an epoch stamped visited array: a pc has been
+  // visited in the current run if its stamp equals the current epoch, so
+  // starting a new run never needs to clear it.
+  class Machine {
+    const Program& program;
+    std::vector<uint32_t> visited;
+    uint32_t epoch;
+
+  public:
+    explicit Machine(const Program& p)
+      : program(p)
+      , visited(p.size(), 0)
+      , epoch(0)
+    { }
+
+    TermCode run(int& acc) {
+      uint64_t steps;
+      return run(acc, steps);
+    }
+
+    TermCode run(int& acc, uint64_t& steps) {
+      if (++epoch == 0) {
+        std::fill(visited.begin(), visited.end(), 0);
+        epoch = 1;
+      }
+
+      const Instruction* code = program.data();
+      uint32_t* seen = visited.data();
+      const uint32_t stamp = epoch;
+      const uint32_t n = program.size();
+      int pc = 0;
+      // Locals rather than the out parameters, so stores to `seen` can't
+      // force them back to memory every step.
+      int a = 0;
+      uint64_t count = 0;
+      TermCode result;
+
+#if defined(__GNUC__)
+      // Computed goto, one indirect jump per instruction
+      static const void* const dispatch[] = { &&op_acc, &&op_jmp, &&op_nop };
+
+#define DISPATCH() do { \
+    if (uint32_t(pc) >= n) { result = TermCode::OK; goto done; } \
+    if (seen[pc] == stamp) { result = TermCode::InfiniteLoop; goto done; } \
+    seen[pc] = stamp; \
+    count++; \
+    goto *dispatch[static_cast<uint8_t>(OpcodeOf(code[pc]))]; \
+} while (0)
+
+      DISPATCH();
+    op_acc:
+      a += ArgOf(code[pc]);
+      pc++;
+      DISPATCH();
+    op_jmp:
+      pc += ArgOf(code[pc]);
+      DISPATCH();
+    op_nop:
+      pc++;
+      DISPATCH();
+
+#undef DISPATCH
+#else
+      result = TermCode::OK;
+      while (uint32_t(pc) < n) {
+        if (seen[pc] == stamp) { result = TermCode::InfiniteLoop; break; }
+        seen[pc] = stamp;
+        count++;
+
+        const auto inst = code[pc];
+        switch (OpcodeOf(inst)) {
+          case Opcode::ACC:
+            a += ArgOf(inst);
+            pc++;
+            break;
+          case Opcode::NOP:
+            pc++;
+            break;
+          case Opcode::JMP:
+            pc += ArgOf(inst);
+            break;
+        }
+      }
+      goto done;
+#endif
+
+    done:
+      acc = a;
+      steps = count;
+      return result;
+    }
+  };
+
+  // Flipping the instruction at `pc` (JMP <-> NOP) makes the program
+  // terminate with `acc` in the accumulator.
+  struct Patch {
+    size_t pc;
+    Opcode from;
+    Opcode to;
+    int acc;
+  };
+
+  std::ostream& operator<<(std::ostream& os, const Opcode& o) {
+    switch (o) {
+      case Opcode::ACC: os << "acc"; break;
+      case Opcode::JMP: os << "jmp"; break;
+      case Opcode::NOP: os << "nop"; break;
+    }
+    return os;
+  }
+
+  std::ostream& operator<<(std::ostream& os, const Patch& p) {
+    os << p.pc << ": " << p.from << " -> " << p.to << " acc " << p.acc;
+    return os;
+  }
+
+  // Finds every single JMP <-> NOP flip that makes the program terminate, in
+  // O(n). Every instruction has one successor, so the instructions that
+  // terminate form a forest under the reversed edges, rooted at those that
+  // step straight out. Walking it finds the accumulator each adds on the
+  // way out. A flip only matters on the original execution path, and it
+  // repairs the program if the flipped successor terminates without coming
+  // back through the flipped instruction, i.e. without being in its subtree.
+  // That can only happen if the original program terminates too, so the
+  // subtrees are kept as preorder intervals.
+  std::vector<Patch> FindRepairs(const Program& program) {
+    const int n = program.size();
+    const auto successor = [&](int pc, Opcode op) {
+      return op == Opcode::JMP ? pc + ArgOf(program[pc]) : pc + 1;
+    };
+    const auto exits = [n](int pc) { return pc < 0 || pc >= n; };
+
+    // Reverse edges in CSR form
+    std::vector<int> offsets(n + 1, 0);
+    std::vector<int> preds(n);
+    std::vector<int> roots;
+    for (int pc = 0; pc < n; pc++) {
+      const int s = successor(pc, OpcodeOf(program[pc]));
+      if (exits(s)) { roots.push_back(pc); } else { offsets[s + 1]++; }
+    }
+    for (int pc = 0; pc < n; pc++) { offsets[pc + 1] += offsets[pc]; }
+    {
+      std::vector<int> fill(offsets.begin(), offsets.end() - 1);
+      for (int pc = 0; pc < n; pc++) {
+        const int s = successor(pc, OpcodeOf(program[pc]));
+        if (!exits(s)) { preds[fill[s]++] = pc; }
+      }
+    }
+
+    // Accumulator gained from each terminating instruction to the exit, and
+    // its subtree as [enter, leave) in preorder; enter is -1 for the rest
+    std::vector<int> acc_to_exit(n, 0);
+    std::vector<int> enter(n, -1);
+    std::vector<int> leave(n, -1);
+    {
+      int clock = 0;
+      // pc and its next reversed edge
+      std::vector<std::pair<int, int>> stack;
+      const auto visit = [&](int pc, int acc) {
+        acc_to_exit[pc] = (OpcodeOf(program[pc]) == Opcode::ACC ? ArgOf(program[pc]) : 0) + acc;
+        enter[pc] = clock++;
+        stack.emplace_back(pc, offsets[pc]);
+      };
+      for (const auto& root : roots) {
+        visit(root, 0);
+        while (!stack.empty()) {
+          const int pc = stack.back().first;
+          const int p = stack.back().second++;
+          if (p < offsets[pc + 1]) {
+            visit(preds[p], acc_to_exit[pc]);
+          } else {
+            leave[pc] = clock;
+            stack.pop_back();
+          }
+        }
+      }
+    }
+    const auto terminates = [&](int pc) { return enter[pc] >= 0; };
+    const auto passes_through = [&](int from, int pc) {
+      return terminates(pc) && enter[pc] <= enter[from] && enter[from] < leave[pc];
+    };
+
+    std::vector<Patch> patches;
+    std::vector<bool> seen(n, false);
     int pc = 0;
-    acc = 0;
-    const int pc_max = program.size();
+    int acc = 0;
+    while (!exits(pc) && !seen[pc]) {
+      seen[pc] = true;
+      const auto op = OpcodeOf(program[pc]);
+      if (op != Opcode::ACC) {
+        const auto to = op == Opcode::JMP ? Opcode::NOP : Opcode::JMP;
+        const int s = successor(pc, to);
+        if (exits(s) || (terminates(s) && !passes_through(s, pc))) {
+          patches.push_back({ size_t(pc), op, to, acc + (exits(s) ? 0 : acc_to_exit[s]) });
+        }
+      } else {
+        acc += ArgOf(program[pc]);
+      }
+      pc = successor(pc, op);
+    }
+
+    return patches;
+  }
 
-    while (pc < pc_max && pc >= 0) {
-      auto& inst = program[pc];
+  // A run of instructions entered only at its first instruction and left
+  // only after its last, summarised so it can be executed in one step.
+  struct BasicBlock {
+    int leader;
+    uint32_t length;
+    int acc;
+    int next;
+  };
+
+  // The block level path a program takes from pc 0, treating the program as
+  // running forever rather than stopping at the first repeat. The path is
+  // the `mu` blocks before the cycle followed by the `lambda` blocks of the
+  // cycle; a halting program "cycles" on the exit with no steps.
+  class BlockTrace {
+    const Program& program;
+    std::vector<BasicBlock> blocks;
+    static constexpr uint32_t NoBlock = ~uint32_t(0);
+
+    // Block index of each leader pc, NoBlock for other pcs
+    std::vector<uint32_t> block_at;
+
+    std::vector<uint32_t> path;
+    // Steps and accumulator before path[i]; one extra entry for the end
+    std::vector<uint64_t> steps;
+    std::vector<int64_t> accs;
+    size_t mu;
+    size_t lambda;
+    bool halt;
+
+    uint32_t halt_block() const { return blocks.size(); }
+
+    uint32_t successor(uint32_t b) const {
+      if (b == halt_block()) { return b; }
+      const int next = blocks[b].next;
+      if (next < 0 || size_t(next) >= program.size()) { return halt_block(); }
+      // Blocks only ever continue at a leader
+      assert(block_at[next] != NoBlock);
+      return block_at[next];
+    }
 
-      const auto arg = std::get<1>(inst);
-      auto& ex = std::get<2>(inst);
-      if (ex) {
-        return TermCode::InfiniteLoop;
+  public:
+    struct State {
+      uint64_t step;
+      int64_t acc;
+      int pc;
+      bool halted;
+    };
+
+    explicit BlockTrace(const Program& p)
+      : program(p)
+      , block_at(p.size(), NoBlock)
+      , mu(0)
+      , lambda(0)
+      , halt(false)
+    {
+      const int n = p.size();
+      if (!n) { throw std::runtime_error("Empty program"); }
+
+      // Leaders are pc 0, jump targets and whatever follows a jump
+      std::vector<bool> leader(n, false);
+      leader[0] = true;
+      for (int pc = 0; pc < n; pc++) {
+        if (OpcodeOf(p[pc]) != Opcode::JMP) { continue; }
+        const int target = pc + ArgOf(p[pc]);
+        if (target >= 0 && target < n) { leader[target] = true; }
+        if (pc + 1 < n) { leader[pc + 1] = true; }
+      }
+
+      for (int pc = 0; pc < n; ) {
+        BasicBlock b{ pc, 0, 0, 0 };
+        do {
+          if (OpcodeOf(p[pc]) == Opcode::ACC) { b.acc += ArgOf(p[pc]); }
+          b.length++;
+        } while (OpcodeOf(p[pc++]) != Opcode::JMP && pc < n && !leader[pc]);
+        b.next = OpcodeOf(p[pc - 1]) == Opcode::JMP ? pc - 1 + ArgOf(p[pc - 1]) : pc;
+        block_at[b.leader] = blocks.size();
+        blocks.push_back(b);
       }
-      ex = true;
-
-      switch (std::get<0>(inst)) {
-        case Opcode::ACC:
-          acc += arg;
-          pc++;
-          break;
-        case Opcode::NOP:
-          pc++;
-          break;
-        case Opcode::JMP:
-          pc += arg;
-          break;
+
+      // Brent's cycle detection over blocks
+      const uint32_t start = block_at[0];
+      size_t power = 1;
+      lambda = 1;
+      uint32_t tortoise = start;
+      uint32_t hare = successor(start);
+      while (tortoise != hare) {
+        if (power == lambda) {
+          tortoise = hare;
+          power *= 2;
+          lambda = 0;
+        }
+        hare = successor(hare);
+        lambda++;
       }
+
+      tortoise = hare = start;
+      for (size_t i = 0; i < lambda; i++) { hare = successor(hare); }
+      while (tortoise != hare) {
+        tortoise = successor(tortoise);
+        hare = successor(hare);
+        mu++;
+      }
+
+      halt = tortoise == halt_block();
+      const size_t length = halt ? mu : mu + lambda;
+      steps.push_back(0);
+      accs.push_back(0);
+      for (uint32_t b = start; path.size() < length; b = successor(b)) {
+        path.push_back(b);
+        steps.push_back(steps.back() + blocks[b].length);
+        accs.push_back(accs.back() + blocks[b].acc);
+      }
+    }
+
+    bool halts() const { return halt; }
+    // Steps before the cycle starts, and steps per trip around it
+    uint64_t prefix_steps() const { return steps[mu]; }
+    uint64_t cycle_steps() const { return halt ? 0 : steps.back() - steps[mu]; }
+    size_t block_count() const { return blocks.size(); }
+
+    // Accumulator and pc after `step` instructions have executed
+    State at(uint64_t step) const {
+      State s{ step, 0, 0, false };
+      int64_t base = 0;
+      uint64_t offset = step;
+
+      if (halt && step >= steps.back()) {
+        s.step = steps.back();
+        s.acc = accs.back();
+        s.pc = program.size();
+        s.halted = true;
+        return s;
+      }
+      if (!halt && step >= steps.back()) {
+        const uint64_t cycle = cycle_steps();
+        const uint64_t trips = (step - steps[mu]) / cycle;
+        base = int64_t(trips) * (accs.back() - accs[mu]);
+        offset = step - trips * cycle;
+      }
+
+      // Last block on the path starting at or before `offset`
+      const size_t i = std::upper_bound(steps.begin(), steps.end() - 1, offset) - steps.begin() - 1;
+      s.acc = base + accs[i];
+      s.pc = blocks[path[i]].leader;
+      for (uint64_t k = steps[i]; k < offset; k++, s.pc++) {
+        if (OpcodeOf(program[s.pc]) == Opcode::ACC) { s.acc += ArgOf(program[s.pc]); }
+      }
+      return s;
     }
-    return TermCode::OK;
+  };
+
+  // Builds a program of `n` instructions made of short acc/nop blocks that
+  // each end in a jmp to the next block, with the blocks shuffled so the
+  // jumps are unpredictable. Every run executes all `n` instructions and
+  // then loops back to the start.
+  Program GenerateBenchmarkProgram(size_t n) {
+    std::mt19937 rng(2020);
+
+    // Blocks in memory order, [starts[b], starts[b + 1])
+    std::vector<size_t> starts;
+    for (size_t pc = 0; pc < n; pc += 1 + rng() % 8) {
+      starts.push_back(pc);
+    }
+    starts.push_back(n);
+    const size_t blocks = starts.size() - 1;
+
+    // Order the blocks are run in, starting at block 0
+    std::vector<size_t> order(blocks);
+    std::iota(order.begin(), order.end(), 0);
+    std::shuffle(order.begin() + 1, order.end(), rng);
+
+    Program program(n);
+    for (size_t k = 0; k < blocks; k++) {
+      const size_t b = order[k];
+      const size_t last = starts[b + 1] - 1;
+      for (size_t pc = starts[b]; pc < last; pc++) {
+        program[pc] = rng() % 2 ? Encode(Opcode::ACC, int(rng() % 7) - 3) : Encode(Opcode::NOP, 0);
+      }
+      const size_t next = starts[order[(k + 1) % blocks]];
+      program[last] = Encode(Opcode::JMP, int(next) - int(last));
+    }
+    return program;
+  }
+
+  void BenchmarkMachine(size_t n, uint64_t target) {
+    const auto program = GenerateBenchmarkProgram(n);
+    Machine vm(program);
+
+    uint64_t total = 0;
+    int acc = 0;
+    const auto start = std::chrono::high_resolution_clock::now();
+    while (total < target) {
+      uint64_t steps;
+      vm.run(acc, steps);
+      total += steps;
+    }
+    const std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+
+    std::cout << total << " instructions in " << elapsed.count() << " sec: " <<
+      (total / elapsed.count() / 1e6) << "M instructions/sec (acc " << acc << ")" << std::endl;
   }
 }
 
 int main(int argc, char** argv) {
+  if (argc > 1 && BENCH_VM == argv[1]) {
+    const size_t n = argc > 2 ? aoc::stoi(argv[2]) : 10000;
+    BenchmarkMachine(n, 100000000);
+    return 0;
+  }
+
   aoc::AutoTimer t;
   const bool inTest = argc < 2;
 
@@ -120,28 +540,50 @@ int main(int argc, char** argv) {
 
   int part1;
   {
-    const auto res = RunProgram(r, part1);
+    Machine vm(r);
+    const auto res = vm.run(part1);
     assert(res == TermCode::InfiniteLoop);
     (void)res;
   }
 
-  int part2 = 0;
-  for (size_t i = 0; i < r.size(); i++) {
-    if (std::get<0>(r[i]) == Opcode::JMP) {
-      Program mod = r;
-      std::get<0>(mod[i]) = Opcode::NOP;
-      const auto res = RunProgram(mod, part2);
-      if (res == TermCode::OK) {
-        break;
-      }
+  const auto patches = FindRepairs(r);
+  int part2 = patches.empty() ? 0 : patches.front().acc;
+
+  aoc::print_results(part1, part2);
+
+  if (argc > 2 && REPAIRS == argv[2]) {
+    for (const auto& p : patches) {
+      std::cout << "Patch " << p << std::endl;
     }
   }
 
-  aoc::print_results(part1, part2);
+  if (argc > 2 && STEPS == argv[2]) {
+    const BlockTrace trace(r);
+    std::cout << trace.block_count() << " basic blocks, ";
+    if (trace.halts()) {
+      std::cout << "halts after " << trace.prefix_steps() << " steps" << std::endl;
+    } else {
+      std::cout << "cycle starts after " << trace.prefix_steps() << " steps, period " << trace.cycle_steps() << " steps" << std::endl;
+    }
+    for (int i = 3; i < argc; i++) {
+      const auto s = trace.at(std::stoull(argv[i]));
+      std::cout << "Step " << s.step << ": acc " << s.acc << " pc " << s.pc << (s.halted ? " (halted)" : "") << std::endl;
+    }
+  }
 
   if (inTest) {
     aoc::assert_result(part1, SR_Part1);
     aoc::assert_result(part2, SR_Part2);
+
+    // The first repeated instruction is where the block path first comes
+    // back round to the start of the cycle.
+    const BlockTrace trace(r);
+    aoc::assert_result(trace.at(trace.prefix_steps() + trace.cycle_steps()).acc, int64_t(SR_Part1));
+
+    const auto halting = FindRepairs(LoadInput(HaltingInput));
+    aoc::assert_result(halting.size(), size_t(1));
+    aoc::assert_result(halting.front().pc, size_t(2));
+    aoc::assert_result(halting.front().acc, 9);
   }
 
   return 0;
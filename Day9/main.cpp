@@ -1,5 +1,7 @@
 #include "aoc/helpers.h"
 
+#include <deque>
+#include <unordered_map>
 #include <vector>
 
 namespace {
@@ -28,63 +30,159 @@ namespace {
   constexpr int SR_Part1 = 127;
   constexpr int SR_Part2 = 62;
 
-  using Result = std::pair<int, int>;
+  using Result = std::pair<int64_t, int64_t>;
+
+  STRING_CONSTANT(RANGES, "ranges");
+
+  // The last `size` numbers in a ring buffer, with a hash multiset over them
+  // so a pair summing to a target is found with one lookup per number.
+  class XmasWindow {
+    std::vector<int64_t> ring;
+    size_t head;
+    size_t count;
+    std::unordered_map<int64_t, uint32_t> counts;
+
+  public:
+    explicit XmasWindow(size_t size)
+      : ring(size)
+      , head(0)
+      , count(0)
+    {
+      if (size < 2) { throw std::runtime_error("Window too small"); }
+      counts.reserve(size);
+    }
+
+    bool full() const { return count == ring.size(); }
 
-  const auto FindTwoWithSum = [](const std::vector<int64_t>& input, const int64_t target, const size_t start) {
-    int64_t ret = 0;
-    for (size_t base = start; base < input.size() - 1; base++) {
-      const int64_t need = target - input[base];
+    // Adds `v`, evicting the oldest number once the window is full
+    void push(int64_t v) {
+      if (full()) {
+        const auto r = counts.find(ring[head]);
+        if (!--r->second) { counts.erase(r); }
+      } else {
+        count++;
+      }
+      ring[head] = v;
+      head = (head + 1) % ring.size();
+      counts[v]++;
+    }
 
-      for (size_t i = start + 1; i < input.size(); i++) {
-        if (input[i] == need) {
-          return need * input[base];
+    // Two different numbers in the window summing to `target`
+    bool has_pair_sum(int64_t target) const {
+      for (size_t i = 0; i < count; i++) {
+        const int64_t need = target - ring[i];
+        if (need != ring[i] && counts.count(need)) {
+          return true;
         }
       }
+      return false;
     }
+  };
 
-    return ret;
+  // [begin, end) of at least two numbers summing to target
+  struct Range {
+    int64_t target;
+    size_t begin;
+    size_t end;
+    int64_t min;
+    int64_t max;
   };
 
-  const auto FindContiguousMinMax = [](const std::vector<int64_t>& input, const int64_t target) {
-    int64_t ret = 0;
-    size_t end = input.size() - 2;
-    for (size_t i = 0; i < end; i++) {
-      int64_t window_size = input[i];
-      size_t j = i + 1;
-      int64_t min = window_size;
-      int64_t max = window_size;
-      while (window_size < target && j < end) {
-        min = std::min(min, input[j]);
-        max = std::max(max, input[j]);
-        window_size += input[j];
-        j++;
-      }
-      if (window_size == target) {
-        return min + max;
+  // Reads numbers one per line from text, counting them
+  class NumberCursor {
+    std::string_view text;
+    size_t index;
+
+  public:
+    explicit NumberCursor(std::string_view t)
+      : text(t)
+      , index(0)
+    { }
+
+    // Index of the number the next call reads
+    size_t position() const { return index; }
+
+    bool next(int64_t& v) {
+      std::string_view line;
+      if (!aoc::getline(text, line)) { return false; }
+      v = aoc::stoi(line);
+      index++;
+      return true;
+    }
+  };
+
+  // Every contiguous range summing to each of `targets`, in O(n) per target.
+  // The window grows on the right and shrinks on the left while its sum is
+  // over the target, which relies on the numbers being positive. The two
+  // ends are cursors over the text, so only the running sum and the
+  // monotonic deques, which keep the window's min and max at their fronts,
+  // are held in memory.
+  const auto FindContiguousRanges = [](std::string_view text, const std::vector<int64_t>& targets) {
+    std::vector<Range> ranges;
+    // (index, value)
+    std::deque<std::pair<size_t, int64_t>> mins;
+    std::deque<std::pair<size_t, int64_t>> maxs;
+
+    for (const auto& target : targets) {
+      mins.clear();
+      maxs.clear();
+      NumberCursor head(text);
+      NumberCursor tail(text);
+      int64_t sum = 0;
+      int64_t v;
+      while (head.next(v)) {
+        const size_t hi = head.position() - 1;
+        sum += v;
+        while (!mins.empty() && mins.back().second >= v) { mins.pop_back(); }
+        while (!maxs.empty() && maxs.back().second <= v) { maxs.pop_back(); }
+        mins.emplace_back(hi, v);
+        maxs.emplace_back(hi, v);
+
+        int64_t dropped;
+        while (sum > target && tail.position() < hi && tail.next(dropped)) {
+          sum -= dropped;
+          const size_t lo = tail.position() - 1;
+          if (mins.front().first == lo) { mins.pop_front(); }
+          if (maxs.front().first == lo) { maxs.pop_front(); }
+        }
+
+        if (sum == target && hi > tail.position()) {
+          ranges.push_back({ target, tail.position(), hi + 1, mins.front().second, maxs.front().second });
+        }
       }
     }
-    return ret;
+
+    return ranges;
+  };
+
+  const auto FindContiguousMinMax = [](std::string_view text, const int64_t target) {
+    const auto ranges = FindContiguousRanges(text, { target });
+    return ranges.empty() ? 0 : ranges.front().min + ranges.front().max;
   };
 
-  const auto LoadInput = [](auto f, size_t prolog_size) {
+  // Streams the input through a window of `window_size` numbers. Only the
+  // window is kept; part 2 reads the numbers before the invalid one again
+  // straight from the input.
+  const auto LoadInput = [](std::string_view f, size_t window_size) {
     Result r{0, 0};
+    const std::string_view input = f;
     std::string_view line;
-    std::vector<int64_t> prolog;
+    XmasWindow window(window_size);
     while (aoc::getline(f, line)) {
       int64_t num = aoc::stoi(line);
-      if (prolog.size() < prolog_size) {
-        prolog.push_back(num);
+      if (!window.full()) {
+        window.push(num);
         continue;
       }
 
-      if (!FindTwoWithSum(prolog, num, prolog.size() - prolog_size)) {
+      if (!window.has_pair_sum(num)) {
         r.first = num;
 
-        r.second = FindContiguousMinMax(prolog, num);
+        r.second = FindContiguousMinMax(input.substr(0, line.data() - input.data()), num);
 
         return r;
       }
-      prolog.push_back(num);
+      window.push(num);
     }
     return r;
   };
@@ -100,11 +198,25 @@ int main(int argc, char** argv) {
   } else {
     std::unique_ptr<MappedFileSource>m(new MappedFileSource(argc, argv));
     std::string_view f(m->data(), m->size());
-    r = LoadInput(f, 25);
+
+    if (argc > 2 && RANGES == argv[2]) {
+      std::vector<int64_t> targets;
+      for (int i = 3; i < argc; i++) {
+        targets.push_back(aoc::stoi(argv[i]));
+      }
+      for (const auto& range : FindContiguousRanges(f, targets)) {
+        std::cout << "Target " << range.target << ": [" << range.begin << ", " << range.end <<
+          ") min " << range.min << " max " << range.max << std::endl;
+      }
+      return 0;
+    }
+
+    const size_t window = argc > 2 ? aoc::stoi(argv[2]) : 25;
+    r = LoadInput(f, window);
   }
 
-  int part1 = 0;
-  int part2 = 0;
+  int64_t part1 = 0;
+  int64_t part2 = 0;
 
   std::tie(part1, part2) = r;
 
@@ -113,6 +225,17 @@ int main(int argc, char** argv) {
   if (inTest) {
     aoc::assert_result(part1, SR_Part1);
     aoc::assert_result(part2, SR_Part2);
+
+    // 678 is the sum of three ranges, and nothing sums to 1
+    const auto ranges = FindContiguousRanges(SampleInput, { 678, 1 });
+    aoc::assert_result(ranges.size(), size_t(3));
+    const std::pair<size_t, size_t> expected[] = { { 0, 12 }, { 10, 15 }, { 12, 16 } };
+    for (size_t i = 0; i < 3; i++) {
+      aoc::assert_result(ranges[i].target, int64_t(678));
+      aoc::assert_result(ranges[i].begin, expected[i].first);
+      aoc::assert_result(ranges[i].end, expected[i].second);
+    }
+    aoc::assert_result(ranges[2].min + ranges[2].max, int64_t(127 + 219));
   }
 
   return 0;
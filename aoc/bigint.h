@@ -0,0 +1,183 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace aoc {
+
+    // Unsigned integer of arbitrary size. Values that fit in 64 bits are kept
+    // inline, and only promoted to a vector of 32 bit limbs when a result
+    // overflows, so small values cost about as much as a uint64_t.
+    class BigUint {
+    private:
+        using Limbs = std::vector<uint32_t>;
+
+        uint64_t small_;
+        // Little endian, always more than two limbs; empty while small
+        Limbs limbs_;
+
+        Limbs limbs() const {
+            if (!is_small()) { return limbs_; }
+            Limbs l{ uint32_t(small_), uint32_t(small_ >> 32) };
+            return l;
+        }
+
+        BigUint& assign(Limbs&& l) {
+            while (!l.empty() && !l.back()) { l.pop_back(); }
+            if (l.size() <= 2) {
+                small_ = l.empty() ? 0 : l[0];
+                if (l.size() == 2) { small_ |= uint64_t(l[1]) << 32; }
+                limbs_.clear();
+            } else {
+                small_ = 0;
+                limbs_ = std::move(l);
+            }
+            return *this;
+        }
+
+    public:
+        BigUint(uint64_t v = 0)
+            : small_(v)
+        { }
+
+        bool is_small() const { return limbs_.empty(); }
+
+        // Only meaningful when is_small()
+        uint64_t to_u64() const { return small_; }
+
+        BigUint& operator+=(const BigUint& o) {
+            if (is_small() && o.is_small()) {
+                uint64_t r;
+                if (!__builtin_add_overflow(small_, o.small_, &r)) {
+                    small_ = r;
+                    return *this;
+                }
+            }
+
+            Limbs a = limbs();
+            const Limbs b = o.limbs();
+            a.resize(std::max(a.size(), b.size()) + 1, 0);
+            uint64_t carry = 0;
+            for (size_t i = 0; i < a.size(); i++) {
+                carry += uint64_t(a[i]) + (i < b.size() ? b[i] : 0);
+                a[i] = uint32_t(carry);
+                carry >>= 32;
+            }
+            return assign(std::move(a));
+        }
+
+        // Requires *this >= o
+        BigUint& operator-=(const BigUint& o) {
+            if (is_small() && o.is_small()) {
+                small_ -= o.small_;
+                return *this;
+            }
+
+            Limbs a = limbs();
+            const Limbs b = o.limbs();
+            int64_t borrow = 0;
+            for (size_t i = 0; i < a.size(); i++) {
+                int64_t d = int64_t(a[i]) - (i < b.size() ? b[i] : 0) - borrow;
+                borrow = d < 0;
+                a[i] = uint32_t(d + (borrow << 32));
+            }
+            return assign(std::move(a));
+        }
+
+        BigUint& operator*=(const BigUint& o) {
+            if (is_small() && o.is_small()) {
+                uint64_t r;
+                if (!__builtin_mul_overflow(small_, o.small_, &r)) {
+                    small_ = r;
+                    return *this;
+                }
+            }
+
+            const Limbs a = limbs();
+            const Limbs b = o.limbs();
+            Limbs r(a.size() + b.size(), 0);
+            for (size_t i = 0; i < a.size(); i++) {
+                uint64_t carry = 0;
+                for (size_t j = 0; j < b.size(); j++) {
+                    carry += uint64_t(a[i]) * b[j] + r[i + j];
+                    r[i + j] = uint32_t(carry);
+                    carry >>= 32;
+                }
+                r[i + b.size()] = uint32_t(carry);
+            }
+            return assign(std::move(r));
+        }
+
+        // Divides in place by `d`, returning the remainder
+        uint32_t divmod(uint32_t d) {
+            if (is_small()) {
+                const uint32_t rem = small_ % d;
+                small_ /= d;
+                return rem;
+            }
+
+            Limbs a = limbs_;
+            uint64_t rem = 0;
+            for (size_t i = a.size(); i-- > 0; ) {
+                rem = (rem << 32) | a[i];
+                a[i] = uint32_t(rem / d);
+                rem %= d;
+            }
+            assign(std::move(a));
+            return uint32_t(rem);
+        }
+
+        // Remainder modulo a 64 bit `d`
+        uint64_t mod(uint64_t d) const {
+            if (is_small()) { return small_ % d; }
+
+            unsigned __int128 rem = 0;
+            for (size_t i = limbs_.size(); i-- > 0; ) {
+                rem = ((rem << 32) | limbs_[i]) % d;
+            }
+            return uint64_t(rem);
+        }
+
+        friend BigUint operator+(BigUint a, const BigUint& b) { return a += b; }
+        friend BigUint operator-(BigUint a, const BigUint& b) { return a -= b; }
+        friend BigUint operator*(BigUint a, const BigUint& b) { return a *= b; }
+
+        friend bool operator==(const BigUint& a, const BigUint& b) {
+            return a.small_ == b.small_ && a.limbs_ == b.limbs_;
+        }
+        friend bool operator!=(const BigUint& a, const BigUint& b) { return !(a == b); }
+
+        friend bool operator<(const BigUint& a, const BigUint& b) {
+            if (a.is_small() || b.is_small()) {
+                return a.is_small() && (!b.is_small() || a.small_ < b.small_);
+            }
+            if (a.limbs_.size() != b.limbs_.size()) { return a.limbs_.size() < b.limbs_.size(); }
+            return std::lexicographical_compare(a.limbs_.rbegin(), a.limbs_.rend(), b.limbs_.rbegin(), b.limbs_.rend());
+        }
+
+        std::string to_string() const {
+            if (is_small()) { return std::to_string(small_); }
+
+            // Nine decimal digits at a time, least significant first
+            BigUint v = *this;
+            std::vector<uint32_t> chunks;
+            while (!v.is_small()) {
+                chunks.push_back(v.divmod(1000000000));
+            }
+            std::string s = std::to_string(v.small_);
+            for (auto it = chunks.rbegin(); it != chunks.rend(); it++) {
+                const auto c = std::to_string(*it);
+                s.append(9 - c.size(), '0');
+                s += c;
+            }
+            return s;
+        }
+    };
+
+    inline std::ostream& operator<<(std::ostream& os, const BigUint& v) {
+        return os << v.to_string();
+    }
+};
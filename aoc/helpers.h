@@ -14,6 +14,7 @@
 #include <cassert>
 #include <functional>
 #include <iomanip>
+#include <memory>
 
 #ifndef NDEBUG
 #define DEBUG(x) do { \